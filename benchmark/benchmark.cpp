@@ -0,0 +1,167 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <sys/resource.h>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include <cxxopts.hpp>
+
+#include "../src/DavidsonSolver.hpp"
+#include "../src/DavidsonOperator.hpp"
+
+// one solve of the sweep
+struct BenchmarkResult
+{
+    int size;
+    double eps;
+    int neigen;
+    std::string correction;
+    std::string linsolve;
+    std::string mode;
+    double wall_time;
+    long matvecs;
+    int iterations;
+    bool converged;
+    long peak_rss_kb;
+};
+
+// comma separated list of values
+std::vector<std::string> split(const std::string &list)
+{
+    std::vector<std::string> values;
+    std::stringstream stream(list);
+    std::string value;
+    while (std::getline(stream,value,','))
+        if (!value.empty()) values.push_back(value);
+    return values;
+}
+
+// the peak resident size is reset before each solve when the kernel allows it
+// (Linux >= 4.0), it is the peak of the whole run otherwise
+void reset_peak_rss()
+{
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    if (clear_refs) clear_refs << "5";
+}
+
+long peak_rss_kb()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status,line)) {
+        if (line.compare(0,6,"VmHWM:") == 0) return std::stol(line.substr(6));
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+    return usage.ru_maxrss;
+}
+
+void write_csv(std::ostream &out, const std::vector<BenchmarkResult> &results)
+{
+    out << "size,eps,neigen,correction,linsolve,mode,wall_time,matvecs,iterations,converged,peak_rss_kb" << std::endl;
+    for (const auto &r : results) {
+        out << r.size << "," << r.eps << "," << r.neigen << "," << r.correction << "," << r.linsolve << ","
+            << r.mode << "," << r.wall_time << "," << r.matvecs << "," << r.iterations << ","
+            << r.converged << "," << r.peak_rss_kb << std::endl;
+    }
+}
+
+void write_json(std::ostream &out, const std::vector<BenchmarkResult> &results)
+{
+    out << "[" << std::endl;
+    for (std::size_t i=0; i<results.size(); i++) {
+        const auto &r = results[i];
+        out << "  {\"size\": " << r.size << ", \"eps\": " << r.eps << ", \"neigen\": " << r.neigen
+            << ", \"correction\": \"" << r.correction << "\", \"linsolve\": \"" << r.linsolve
+            << "\", \"mode\": \"" << r.mode << "\", \"wall_time\": " << r.wall_time
+            << ", \"matvecs\": " << r.matvecs << ", \"iterations\": " << r.iterations
+            << ", \"converged\": " << (r.converged ? "true" : "false")
+            << ", \"peak_rss_kb\": " << r.peak_rss_kb << "}" << (i+1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "]" << std::endl;
+}
+
+int main (int argc, char *argv[]){
+
+    cxxopts::Options options(argv[0],  "Benchmark of the Davidson solver");
+    options.add_options()
+        ("size", "dimensions of the matrices", cxxopts::value<std::string>()->default_value("500,1000,2000"))
+        ("eps", "sparsity of the matrices", cxxopts::value<std::string>()->default_value("0.01,0.001"))
+        ("neigen", "numbers of eigenvalues", cxxopts::value<std::string>()->default_value("5,10"))
+        ("corr", "correction methods (DPR, OLSEN, JACOBI)", cxxopts::value<std::string>()->default_value("DPR,OLSEN,JACOBI"))
+        ("linsolve", "linear solvers of the Jacobi correction (CG, GMRES, LLT)", cxxopts::value<std::string>()->default_value("CG,GMRES"))
+        ("mode", "operators (dense, mf)", cxxopts::value<std::string>()->default_value("dense,mf"))
+        ("tol", "tolerance on the residue norm", cxxopts::value<std::string>()->default_value("1E-6"))
+        ("repeat", "solves per configuration, the fastest is kept", cxxopts::value<std::string>()->default_value("1"))
+        ("format", "output format (json, csv)", cxxopts::value<std::string>()->default_value("json"))
+        ("output", "output file", cxxopts::value<std::string>()->default_value("benchmark.json"))
+        ("help", "Print the help", cxxopts::value<bool>());
+    auto result = options.parse(argc,argv);
+
+    if (result.count("help"))
+    {
+        std::cout << options.help({""}) << std::endl;
+        exit(0);
+    }
+
+    double tol = std::stod(result["tol"].as<std::string>(),nullptr);
+    int repeat = std::stoi(result["repeat"].as<std::string>(),nullptr);
+    std::string format = result["format"].as<std::string>();
+    std::vector<BenchmarkResult> results;
+
+    for (const auto &size_str : split(result["size"].as<std::string>()))
+    for (const auto &eps_str : split(result["eps"].as<std::string>())) {
+
+        int size = std::stoi(size_str,nullptr);
+        double eps = std::stod(eps_str,nullptr);
+        DavidsonOperator Aop(size,eps,false,false);
+        Eigen::MatrixXd Afull = Aop.get_full_mat();
+
+        for (const auto &neigen_str : split(result["neigen"].as<std::string>()))
+        for (const auto &correction : split(result["corr"].as<std::string>()))
+        for (const auto &linsolve : split(result["linsolve"].as<std::string>()))
+        for (const auto &mode : split(result["mode"].as<std::string>())) {
+
+            // the linear solver only matters for the Jacobi correction
+            if (correction != "JACOBI" and linsolve != split(result["linsolve"].as<std::string>()).front()) continue;
+
+            BenchmarkResult r;
+            r.size = size;
+            r.eps = eps;
+            r.neigen = std::stoi(neigen_str,nullptr);
+            r.correction = correction;
+            r.linsolve = (correction == "JACOBI") ? linsolve : "-";
+            r.mode = mode;
+            r.wall_time = -1;
+
+            for (int k=0; k<repeat; k++) {
+                DavidsonSolver DS;
+                DS.set_correction(correction);
+                DS.set_tolerance(tol);
+                if (correction == "JACOBI") DS.set_jacobi_linsolve(linsolve);
+
+                reset_peak_rss();
+                auto start = std::chrono::steady_clock::now();
+                if (mode == "mf") DS.solve(Aop,r.neigen);
+                else DS.solve(Afull,r.neigen);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+                if (r.wall_time < 0 or elapsed.count() < r.wall_time) r.wall_time = elapsed.count();
+                r.matvecs = DS.matvecs();
+                r.iterations = DS.iterations();
+                r.converged = DS.converged();
+                r.peak_rss_kb = peak_rss_kb();
+            }
+            results.push_back(r);
+        }
+    }
+
+    std::ofstream out(result["output"].as<std::string>());
+    if (format == "csv") write_csv(out,results);
+    else write_json(out,results);
+    std::cout << results.size() << " results written to " << result["output"].as<std::string>() << std::endl;
+
+}
@@ -0,0 +1,70 @@
+#include <iostream>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <exception>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+
+#include "DavidsonBatch.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+template<typename Scalar>
+void DavidsonBatchT<Scalar>::solve()
+{
+    int nproblems = this->_problems.size();
+
+    // queue of the problems by decreasing cost
+    std::vector<int> queue(nproblems);
+    std::iota(queue.begin(),queue.end(),0);
+    std::stable_sort(queue.begin(),queue.end(),[&](int i, int j) {
+        return static_cast<double>(this->_problems[i].size) * this->_problems[i].neigen
+             > static_cast<double>(this->_problems[j].size) * this->_problems[j].neigen;
+    });
+
+    int nthreads = this->num_threads;
+#ifdef _OPENMP
+    if (nthreads <= 0) nthreads = omp_get_max_threads();
+#endif
+    nthreads = std::max(1,std::min(nthreads,nproblems));
+
+    // one solver per thread, the threads of a single solve are not changed
+    // (Eigen::setNbThreads is global)
+    std::vector<DavidsonSolverT<Scalar>> solvers(nthreads,this->_solver);
+    for (auto &DS : solvers) DS.num_threads = 0;
+    std::vector<std::exception_ptr> errors(nproblems);
+
+    #pragma omp parallel for schedule(dynamic,1) num_threads(nthreads)
+    for (int k=0; k<nproblems; k++) {
+        int tid = 0;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+#endif
+        Problem &problem = this->_problems[queue[k]];
+        DavidsonSolverT<Scalar> &DS = solvers[tid];
+        DS.tol = (problem.tol > 0) ? problem.tol : this->_solver.tol;
+
+        try {
+            problem.solve(DS);
+            problem.eigenvalues = DS.eigenvalues();
+            problem.eigenvectors = DS.eigenvectors();
+            problem.converged = DS.converged();
+            problem.iterations = DS.iterations();
+        }
+        catch (...) {
+            errors[queue[k]] = std::current_exception();
+        }
+    }
+
+    for (auto &error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+template class DavidsonBatchT<float>;
+template class DavidsonBatchT<double>;
+template class DavidsonBatchT<std::complex<float>>;
+template class DavidsonBatchT<std::complex<double>>;
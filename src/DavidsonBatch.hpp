@@ -0,0 +1,79 @@
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+
+#include "DavidsonSolver.hpp"
+
+#ifndef _DAVIDSON_BATCH_
+#define _DAVIDSON_BATCH_
+
+// Batch of independent eigenproblems solved concurrently
+//
+// each OpenMP thread owns a solver, whose workspace is reused from one
+// problem to the next, and takes the next problem of a queue sorted by
+// decreasing cost (size x neigen) : the largest problems start first and
+// the small ones fill the gaps left at the end
+// the products of the operators and the dense kernels run on one thread
+template<typename Scalar>
+class DavidsonBatchT
+{
+	public:
+
+		typedef typename DavidsonSolverT<Scalar>::RealVectorX RealVectorX;
+		typedef typename DavidsonSolverT<Scalar>::MatrixX MatrixX;
+
+		// all the problems are solved with the settings of solver
+		// (a log sink or an observer is called from several threads)
+		explicit DavidsonBatchT(const DavidsonSolverT<Scalar> &solver = DavidsonSolverT<Scalar>()) : _solver(solver) {}
+
+		// 0 : OpenMP default
+		void set_num_threads(int N) {this->num_threads = N;}
+
+		// add a problem and returns its index, the operator is not copied and
+		// must outlive solve(), tol = 0 uses the tolerance of the solver
+		template <typename MatrixReplacement>
+		int add(MatrixReplacement &A, int neigen, double tol = 0)
+		{
+		    Problem problem;
+		    problem.size = A.rows();
+		    problem.neigen = neigen;
+		    problem.tol = tol;
+		    problem.solve = [&A,neigen](DavidsonSolverT<Scalar> &DS) {DS.solve(A,neigen);};
+		    this->_problems.push_back(problem);
+		    return this->_problems.size()-1;
+		}
+
+		// solve all the problems, the first exception thrown by a
+		// problem is rethrown once all the others are done
+		void solve();
+
+		int size() const {return this->_problems.size();}
+		const RealVectorX& eigenvalues(int i) const {return this->_problems[i].eigenvalues;}
+		const MatrixX& eigenvectors(int i) const {return this->_problems[i].eigenvectors;}
+		bool converged(int i) const {return this->_problems[i].converged;}
+		int iterations(int i) const {return this->_problems[i].iterations;}
+
+	private:
+
+		struct Problem
+		{
+			std::function<void(DavidsonSolverT<Scalar> &)> solve;
+			int size = 0;
+			int neigen = 0;
+			double tol = 0;
+			RealVectorX eigenvalues;
+			MatrixX eigenvectors;
+			bool converged = false;
+			int iterations = 0;
+		};
+
+		DavidsonSolverT<Scalar> _solver;
+		std::vector<Problem> _problems;
+		int num_threads = 0;
+};
+
+typedef DavidsonBatchT<double> DavidsonBatch;
+
+#endif
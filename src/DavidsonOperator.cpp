@@ -35,32 +35,52 @@ Eigen::VectorXd DavidsonOperator::reorder_col(Eigen::VectorXd& col) const
 {
     Eigen::VectorXd out = Eigen::VectorXd::Zero(_size,1);
     for (int j=0; j < _size; j++)
-        out(j) = col(_order_index(j));
+        out(j) = col(_perm(j));
     return out;
 }  
 
+// element (i,j) of the operator before reordering
+double DavidsonOperator::_element(int i, int j) const
+{
+    if (i==j) return diag_el(i);
+    return _sparsity / std::pow( static_cast<double>(i-j),2);
+}
+
 //  get a col of the operator
-Eigen::VectorXd DavidsonOperator::col(int index_orig) const
+Eigen::VectorXd DavidsonOperator::col(int index) const
 {
-    int index = index_orig;
-    if (_reorder)
-        index = _order_index(index_orig);
+    int pcol = _perm(index);
     Eigen::VectorXd col_out = Eigen::VectorXd::Zero(_size,1);    
     for (int j=0; j < _size; j++)
-    {
-        if (j==index) {
-            col_out(j) =  diag_el(j); 
-        }
-        else{
-            col_out(j) = _sparsity / std::pow( static_cast<double>(j-index),2) ;
-        }
-    }
+        col_out(j) = _element(_perm(j),pcol);
+    return col_out;
+}
 
-    if (_reorder)
-        col_out = DavidsonOperator::reorder_col(col_out);
+// diagonal elements are read directly from diag_el
+double DavidsonOperator::diagonal_element(int index) const
+{
+    return diag_el(_perm(index));
+}
 
-    return col_out;
+Eigen::VectorXd DavidsonOperator::diagonal() const
+{
+    if (!_reorder) return diag_el;
+    Eigen::VectorXd D = Eigen::VectorXd::Zero(_size,1);
+    for (int i=0; i<_size; i++)
+        D(i) = diag_el(_perm(i));
+    return D;
+}
 
+// the panels used in apply() are filled analytically
+// no column is allocated
+void DavidsonOperator::_fill_panel(int start, Eigen::Ref<Eigen::MatrixXd> panel) const
+{
+    #pragma omp parallel for schedule(static)
+    for (int i=0; i<panel.cols(); i++) {
+        int pcol = _perm(start+i);
+        for (int j=0; j<_size; j++)
+            panel(j,i) = _element(_perm(j),pcol);
+    }
 }
 
 
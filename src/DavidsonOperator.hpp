@@ -14,12 +14,18 @@ class DavidsonOperator : public MatrixFreeOperator
 		Eigen::VectorXd col(int index) const;
 		Eigen::ArrayXd _sort_index(Eigen::VectorXd& V) const;	
 		Eigen::VectorXd reorder_col(Eigen::VectorXd& col) const;
+		double diagonal_element(int index) const;
+		Eigen::VectorXd diagonal() const;
 		
 	private:
 		double _sparsity = 0.1;
 		bool _odiag = false;
 		bool _reorder;
 		Eigen::ArrayXd _order_index;
+
+		int _perm(int index) const {return _reorder ? static_cast<int>(_order_index(index)) : index;}
+		double _element(int i, int j) const;
+		void _fill_panel(int start, Eigen::Ref<Eigen::MatrixXd> panel) const;
 };
 
 #endif
@@ -7,27 +7,83 @@
 #include <Eigen/IterativeLinearSolvers>
 #include <unsupported/Eigen/IterativeSolvers>
 #include <chrono>
+#include <cstdarg>
+#include <cstdio>
 
 #include "DavidsonSolver.hpp"
 
-DavidsonSolver::DavidsonSolver(){}
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
+template<typename Scalar>
+DavidsonSolverT<Scalar>::DavidsonSolverT(){}
 
-void DavidsonSolver::set_correction(std::string method) {
+
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::set_correction(std::string method) {
     if (method == "DPR") this->correction = CORR::DPR;
     else if (method == "JACOBI") this->correction = CORR::JACOBI;
     else if (method == "OLSEN") this->correction = CORR::OLSEN;
     else throw std::runtime_error("Not a valid correction method");
 }
 
-void DavidsonSolver::set_jacobi_linsolve(std::string method) {
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::set_jacobi_linsolve(std::string method) {
     if (method == "CG") this->jacobi_linsolve = LSOLVE::CG;
     else if (method == "GMRES") this->jacobi_linsolve = LSOLVE::GMRES;
     else if (method == "LLT") this->jacobi_linsolve = LSOLVE::LLT;   
     else throw std::runtime_error("Not a valid linsolve method");
 }
 
-Eigen::ArrayXd DavidsonSolver::_sort_index(Eigen::VectorXd& V) const
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::set_orthogonalization(std::string method) {
+    if (method == "GS") this->orthogonalization = ORTHO::GS;
+    else if (method == "QR") this->orthogonalization = ORTHO::QR;
+    else if (method == "BCGS2") this->orthogonalization = ORTHO::BCGS2;
+    else throw std::runtime_error("Not a valid orthogonalization method");
+}
+
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::set_preconditioner(std::string method) {
+    if (method == "DIAGONAL") this->preconditioning = PRECOND::DIAGONAL;
+    else if (method == "CLAMPED") this->preconditioning = PRECOND::CLAMPED;
+    else throw std::runtime_error("Not a valid preconditioner");
+    this->preconditioner = nullptr;
+}
+
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::set_verbose(bool flag) {
+    if (flag) this->log_sink = [](const std::string &message) {std::cout << message << std::flush;};
+    else this->log_sink = nullptr;
+}
+
+// printf-like message sent to the log sink, nothing is formatted without one
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::_log(const char *format, ...) const
+{
+    if (!this->log_sink) return;
+    char buffer[512];
+    va_list args;
+    va_start(args,format);
+    vsnprintf(buffer,sizeof(buffer),format,args);
+    va_end(args);
+    this->log_sink(buffer);
+}
+
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::_set_num_threads() const
+{
+    // 0 keeps the OpenMP default
+    if (this->num_threads <= 0) return;
+#ifdef _OPENMP
+    omp_set_num_threads(this->num_threads);
+#endif
+    Eigen::setNbThreads(this->num_threads);
+}
+
+template<typename Scalar>
+Eigen::ArrayXd DavidsonSolverT<Scalar>::_sort_index(RealVectorX& V) const
 {
     Eigen::ArrayXd idx = Eigen::ArrayXd::LinSpaced(V.rows(),0,V.rows()-1);
     std::sort(idx.data(),idx.data()+idx.size(),
@@ -35,125 +91,372 @@ Eigen::ArrayXd DavidsonSolver::_sort_index(Eigen::VectorXd& V) const
     return idx; 
 }
 
-Eigen::MatrixXd DavidsonSolver::_get_initial_eigenvectors(Eigen::VectorXd &d, int size_initial_guess) const
+template<typename Scalar>
+typename DavidsonSolverT<Scalar>::MatrixX DavidsonSolverT<Scalar>::_get_initial_eigenvectors(VectorX &d, int size_initial_guess) const
 {
 
-    Eigen::MatrixXd guess;
+    MatrixX guess;
     if (this->guess_vectors =="identity")
     {
-            guess = Eigen::MatrixXd::Identity(d.size(),size_initial_guess);
+            guess = MatrixX::Identity(d.size(),size_initial_guess);
     }
 
     else if (this->guess_vectors == "random")
     {
-        guess = Eigen::MatrixXd::Random(d.size(),size_initial_guess);
-        guess = DavidsonSolver::_QR(guess);
+        guess = MatrixX::Random(d.size(),size_initial_guess);
+        guess = DavidsonSolverT::_QR(guess);
     }
     else if (this->guess_vectors=="target")
     {
-        guess = Eigen::MatrixXd::Zero(d.size(),size_initial_guess);
-        Eigen::ArrayXd idx = DavidsonSolver::_sort_index(d);
+        guess = MatrixX::Zero(d.size(),size_initial_guess);
+        // closest to sigma in target mode
+        RealVectorX dr = d.real();
+        if (this->target) dr = (dr.array() - RealScalar(this->sigma)).abs();
+        Eigen::ArrayXd idx = DavidsonSolverT::_sort_index(dr);
 
         for (int j=0; j<size_initial_guess;j++) {
-            guess(idx(j),j) = 1.0;
+            guess(static_cast<int>(idx(j)),j) = Scalar(1);
         }
     }
     return guess;
 }
 
-Eigen::MatrixXd DavidsonSolver::_solve_linear_system(Eigen::MatrixXd &A, Eigen::VectorXd &r) const
+template<typename Scalar>
+typename DavidsonSolverT<Scalar>::MatrixX DavidsonSolverT<Scalar>::_complete_guess(const MatrixX &X, VectorX &d, int size_initial_guess) const
 {
-    Eigen::MatrixXd w;
-    std::chrono::time_point<std::chrono::system_clock> start, end;
-    std::chrono::duration<double> elapsed_time;
+    // orthonormal guess made of the columns of X completed by the
+    // usual guess vectors, the dependent columns are dropped
+    MatrixX guess(d.size(),X.cols()+size_initial_guess);
+    guess.leftCols(X.cols()) = X;
+    guess.rightCols(size_initial_guess) = DavidsonSolverT::_get_initial_eigenvectors(d,size_initial_guess);
+
+    int nkept = DavidsonSolverT::_block_gramschmidt(guess,0);
+    return guess.leftCols(std::min(nkept,size_initial_guess));
+}
 
-    start = std::chrono::system_clock::now();
+template<typename Scalar>
+typename DavidsonSolverT<Scalar>::MatrixX DavidsonSolverT<Scalar>::_solve_linear_system(MatrixX &A, VectorX &r) const
+{
+    MatrixX w;
+    DavidsonTimer timer(this->_stats.linsolve);
     switch (this->jacobi_linsolve) {
 
         case LSOLVE::CG :  {
-                Eigen::ConjugateGradient<Eigen::MatrixXd, Eigen::Lower|Eigen::Upper> cg;
+                Eigen::ConjugateGradient<MatrixX, Eigen::Lower|Eigen::Upper> cg;
                 cg.setTolerance(this->linsolve_tol);
                 cg.compute(A);
                 w = cg.solve(r); 
+                this->_stats.linsolve.count += cg.iterations();
             }
             break;
         case LSOLVE::GMRES : {
-                Eigen::GMRES<Eigen::MatrixXd, Eigen::IdentityPreconditioner> gmres;
+                Eigen::GMRES<MatrixX, Eigen::IdentityPreconditioner> gmres;
                 gmres.setTolerance(this->linsolve_tol);
                 gmres.compute(A);
                 w = gmres.solve(r);
+                this->_stats.linsolve.count += gmres.iterations();
             }
             break;
         case LSOLVE::LLT : 
             w = A.llt().solve(r);
             break;
     }
-    end = std::chrono::system_clock::now();
-    elapsed_time  = end-start;
-    std::cout << "_ solve linear system " << this->jacobi_linsolve << " in " << elapsed_time.count() << " secs" <<  std::endl;
     return w;
 }
 
-Eigen::VectorXd DavidsonSolver::_olsen_correction(Eigen::VectorXd &r, Eigen::VectorXd &x, Eigen::VectorXd &D, double lambda) const
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::_olsen_correction(const PreconditionerT<Scalar> &M, Eigen::Ref<MatrixX> R, const Eigen::Ref<const MatrixX> &BX, const RealVectorX &lambda) const
 {
-    /* Compute the olsen correction :
+    /* Compute the olsen corrections in place of the residues :
+
+    \delta = - M(\lambda)^{-1} (r - \epsilon B x)
 
-    \delta = (D-\lambda)^{-1} (-r + \epsilon x)
+    with \epsilon such that x^T B \delta = 0 (B = I for the standard problem)
 
     */
 
-    int size = r.rows();
-    Eigen::VectorXd delta = Eigen::VectorXd::Zero(size);
+    MatrixX MBX = BX;
+    M.apply(MBX,lambda);
+    M.apply(R,lambda);
 
-    delta = DavidsonSolver::_dpr_correction(r,D,lambda);
+    for (int i=0; i<R.cols(); i++) {
+        Scalar eps = BX.col(i).dot(R.col(i)) / BX.col(i).dot(MBX.col(i));
+        R.col(i) -= eps * MBX.col(i);
+    }
+    R = -R;
+}
 
-    double _num = - x.transpose() * delta;
-    double _denom = - x.transpose() * DavidsonSolver::_dpr_correction(x,D,lambda);
-    double eps = _num / _denom;
-    delta += eps * x;
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::_dpr_correction(const PreconditionerT<Scalar> &M, Eigen::Ref<MatrixX> R, const RealVectorX &lambda) const
+{
+    // in place : r = - M(lambda)^{-1} r, i.e. (lambda B0 - A0)^{-1} r
+    // for the diagonal preconditioner
+    M.apply(R,lambda);
+    R = -R;
+}
 
-    return delta;
+template<typename Scalar>
+int DavidsonSolverT<Scalar>::_svqb( Eigen::Ref<MatrixX> W, Eigen::Ref<MatrixX> BW ) const
+{
+    /* B-orthonormalize W in place from the eigendecomposition of its Gram matrix
+
+    S = D^{-1/2} W^H B W D^{-1/2} = Q \Lambda Q^H      W = W D^{-1/2} Q \Lambda^{-1/2}
+
+    where D = diag(W^H B W). The directions with small eigenvalues are dropped.
+    Returns the number of columns kept, BW is rotated with W.
+
+    */
+
+    int n = W.cols();
+    if (n == 0) return 0;
+    MatrixX S = W.adjoint() * BW;
+    RealVectorX d = S.diagonal().real().cwiseMax(RealScalar(0)).cwiseSqrt();
+    for (int i=0; i<n; i++) {
+        if (d(i) == RealScalar(0)) d(i) = RealScalar(1);
+    }
+    S = d.cwiseInverse().asDiagonal() * S * d.cwiseInverse().asDiagonal();
+
+    Eigen::SelfAdjointEigenSolver<MatrixX> es(S);
+    RealScalar max_eig = es.eigenvalues().cwiseAbs().maxCoeff();
+    int nkept = 0;
+    MatrixX X(n,n);
+    for (int i=n-1; i>=0; i--) {
+        RealScalar e = es.eigenvalues()(i);
+        if (e <= this->orth_tol * max_eig) break;
+        X.col(nkept) = d.cwiseInverse().asDiagonal() * es.eigenvectors().col(i) / std::sqrt(e);
+        nkept++;
+    }
+
+    MatrixX tmp = W * X.leftCols(nkept);
+    W.leftCols(nkept) = tmp;
+    tmp.noalias() = BW * X.leftCols(nkept);
+    BW.leftCols(nkept) = tmp;
+    return nkept;
 }
 
-Eigen::VectorXd DavidsonSolver::_dpr_correction(Eigen::VectorXd &w, Eigen::VectorXd &A0, double lambda) const
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::_harmonic_ritz(const DavidsonWorkspace<Scalar> &ws, int nvec, RealVectorX &lambda, MatrixX &U) const
 {
-    int size = w.rows();
-    Eigen::VectorXd out = Eigen::VectorXd::Zero(size);
-    for (int i=0; i < size; i++) {
-        out(i) = w(i) / (lambda - A0(i));
+    /* Harmonic Ritz vectors around sigma : with an orthonormal V
+
+    V^H (A - \sigma)^H (A - \sigma) V y = \nu V^H (A - \sigma) V y
+
+    the harmonic Ritz values \theta = \sigma + \nu closest to sigma are the
+    largest eigenvalues 1/\nu of
+
+    (T - \sigma) y = 1/\nu G y      G = (AV)^H AV - \sigma (T + T^H) + \sigma^2
+
+    The Ritz values are the Rayleigh quotients y^H T y of the unit vectors y.
+
+    */
+
+    MatrixX H = ws.T.topLeftCorner(nvec,nvec);
+    MatrixX G = ws.AVtAV.topLeftCorner(nvec,nvec);
+    G -= RealScalar(this->sigma) * (H + H.adjoint());
+    G.diagonal().array() += Scalar(this->sigma * this->sigma);
+    H.diagonal().array() -= Scalar(this->sigma);
+
+    Eigen::GeneralizedSelfAdjointEigenSolver<MatrixX> ges(H,G);
+    U = ges.eigenvectors();
+    U.colwise().normalize();
+
+    const MatrixX T = ws.T.topLeftCorner(nvec,nvec);
+    lambda.resize(nvec);
+    for (int i=0; i<nvec; i++) {
+        lambda(i) = std::real(U.col(i).dot(T * U.col(i)));
     }
 
-    return out;
+    // sorted by |\nu|
+    RealVectorX dist = ges.eigenvalues().cwiseAbs().cwiseInverse();
+    DavidsonSolverT::_sort_by_target(lambda,U,dist);
 }
 
-Eigen::MatrixXd DavidsonSolver::_QR(Eigen::MatrixXd &A) const
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::_sort_by_target(RealVectorX &lambda, MatrixX &U, const RealVectorX &dist) const
+{
+    // reorder the Ritz pairs by increasing dist
+    RealVectorX d = dist;
+    Eigen::ArrayXd idx = DavidsonSolverT::_sort_index(d);
+    RealVectorX lambda_sorted(lambda.size());
+    MatrixX U_sorted(U.rows(),U.cols());
+    for (int i=0; i<idx.size(); i++) {
+        lambda_sorted(i) = lambda(static_cast<int>(idx(i)));
+        U_sorted.col(i) = U.col(static_cast<int>(idx(i)));
+    }
+    lambda = lambda_sorted;
+    U = U_sorted;
+}
+
+template<typename Scalar>
+typename DavidsonSolverT<Scalar>::MatrixX DavidsonSolverT<Scalar>::_QR(MatrixX &A) const
 {
     
     int nrows = A.rows();
     int ncols = A.cols();
     ncols = std::min(nrows,ncols);
     
-    Eigen::HouseholderQR<Eigen::MatrixXd> qr(A);
-    return qr.householderQ() * Eigen::MatrixXd::Identity(nrows,ncols);
+    Eigen::HouseholderQR<MatrixX> qr(A);
+    return qr.householderQ() * MatrixX::Identity(nrows,ncols);
 }
 
 
-Eigen::MatrixXd DavidsonSolver::_gramschmidt( Eigen::MatrixXd &A, int nstart ) const
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::_gramschmidt( Eigen::Ref<MatrixX> Q, int nstart ) const
 {
-    Eigen::MatrixXd Q = A;
-
-    for(unsigned int j = nstart; j < A.cols(); ++j) {
+    // orthonormalize in place the columns nstart: of Q
+    VectorX c;
+    for(int j = nstart; j < Q.cols(); ++j) {
+        RealScalar norm = Q.col(j).norm();
         // Replace inner loop over each previous vector in Q with fast matrix-vector multiplication
-        Q.col(j) -= Q.leftCols(j) * (Q.leftCols(j).transpose() * A.col(j));
+        c.noalias() = Q.leftCols(j).adjoint() * Q.col(j);
+        Q.col(j).noalias() -= Q.leftCols(j) * c;
+        // second pass to recover the orthogonality lost by cancellation
+        c.noalias() = Q.leftCols(j).adjoint() * Q.col(j);
+        Q.col(j).noalias() -= Q.leftCols(j) * c;
         // Normalize vector if possible (othw. means colums of A almsost lin. dep.
-        if( Q.col(j).norm() <= 10e-14 * A.col(j).norm() ) {
-            std::cerr << "Gram-Schmidt failed because A has lin. dep columns. Bye." << std::endl;
-            break;
-        } else {
-            Q.col(j).normalize();
+        // and the column is replaced by a random direction)
+        if( Q.col(j).norm() <= Eigen::NumTraits<RealScalar>::dummy_precision() * norm ) {
+            std::cerr << "Gram-Schmidt : lin. dep. column replaced by a random vector" << std::endl;
+            Q.col(j).setRandom();
+            c.noalias() = Q.leftCols(j).adjoint() * Q.col(j);
+            Q.col(j).noalias() -= Q.leftCols(j) * c;
+            c.noalias() = Q.leftCols(j).adjoint() * Q.col(j);
+            Q.col(j).noalias() -= Q.leftCols(j) * c;
+        } 
+        Q.col(j).normalize();
+    }
+}
+
+
+template<typename Scalar>
+int DavidsonSolverT<Scalar>::_orthogonalize( Eigen::Ref<MatrixX> Q, int nstart ) const
+{
+    // orthonormalize the columns nstart: of Q against the previous ones
+    // returns the number of new columns kept
+    switch (this->orthogonalization) {
+        case ORTHO::GS :
+            DavidsonSolverT::_gramschmidt(Q,nstart);
+            return Q.cols()-nstart;
+        case ORTHO::QR :
+            return DavidsonSolverT::_block_QR(Q,nstart);
+        case ORTHO::BCGS2 :
+            return DavidsonSolverT::_block_gramschmidt(Q,nstart);
+    }
+    return Q.cols()-nstart;
+}
+
+template<typename Scalar>
+void DavidsonSolverT<Scalar>::_project_out( Eigen::Ref<MatrixX> Q, int nstart ) const
+{
+    /* Block classical Gram-Schmidt with reorthogonalization (twice is enough)
+
+    W = W - V (V^T W)
+
+    where V = Q(:,:nstart) and W = Q(:,nstart:)
+
+    */
+
+    int nnew = Q.cols()-nstart;
+    MatrixX C(nstart,nnew);
+    for (int ipass=0; ipass<2; ipass++) {
+        C.noalias() = Q.leftCols(nstart).adjoint() * Q.rightCols(nnew);
+        Q.rightCols(nnew).noalias() -= Q.leftCols(nstart) * C;
+    }
+}
+
+template<typename Scalar>
+int DavidsonSolverT<Scalar>::_block_gramschmidt( Eigen::Ref<MatrixX> Q, int nstart ) const
+{
+    // project the new block out of the search space with gemms
+    int nnew = Q.cols()-nstart;
+    RealVectorX norms = Q.rightCols(nnew).colwise().norm();
+    DavidsonSolverT::_project_out(Q,nstart);
+
+    // orthonormalize inside the block and drop the dependent columns
+    int nkept = 0;
+    VectorX c;
+    for (int j=0; j<nnew; j++) {
+        int k = nstart+nkept;
+        if (k != nstart+j) Q.col(k) = Q.col(nstart+j);
+        for (int ipass=0; ipass<2; ipass++) {
+            c.noalias() = Q.middleCols(nstart,nkept).adjoint() * Q.col(k);
+            Q.col(k).noalias() -= Q.middleCols(nstart,nkept) * c;
+        }
+        if (Q.col(k).norm() > this->orth_tol * norms(j)) {
+            Q.col(k).normalize();
+            nkept++;
         }
     }
-    return Q;
+
+    // all the corrections are in the search space already
+    // fall back on a random direction so that the search space still grows
+    if (nkept == 0 and nnew > 0) {
+        std::cerr << "Block Gram-Schmidt : all corrections dependent, adding a random vector" << std::endl;
+        Q.col(nstart).setRandom();
+        DavidsonSolverT::_project_out(Q.leftCols(nstart+1),nstart);
+        Q.col(nstart).normalize();
+        nkept = 1;
+    }
+    return nkept;
 }
 
+template<typename Scalar>
+int DavidsonSolverT<Scalar>::_block_QR( Eigen::Ref<MatrixX> Q, int nstart ) const
+{
+    // project the new block out of the search space with gemms
+    int nnew = Q.cols()-nstart;
+    RealScalar norm = Q.rightCols(nnew).colwise().norm().maxCoeff();
+    DavidsonSolverT::_project_out(Q,nstart);
+
+    // rank revealing QR of the new block
+    Eigen::ColPivHouseholderQR<MatrixX> qr(Q.rightCols(nnew));
+    int nkept = 0;
+    if (qr.maxPivot() > this->orth_tol * norm) {
+        qr.setThreshold(this->orth_tol * norm / qr.maxPivot());
+        nkept = qr.rank();
+    }
+
+    if (nkept == 0) {
+        std::cerr << "Block QR : all corrections dependent, adding a random vector" << std::endl;
+        Q.col(nstart).setRandom();
+        DavidsonSolverT::_project_out(Q.leftCols(nstart+1),nstart);
+        Q.col(nstart).normalize();
+        return 1;
+    }
+
+    MatrixX W = qr.householderQ() * MatrixX::Identity(Q.rows(),nkept);
+    Q.middleCols(nstart,nkept) = W;
+
+    // the householder vectors are orthogonal to the search space
+    // up to round-off : one more projection
+    DavidsonSolverT::_project_out(Q.leftCols(nstart+nkept),nstart);
+    Q.middleCols(nstart,nkept).colwise().normalize();
+    return nkept;
+}
+
+template<typename Scalar>
+typename DavidsonSolverT<Scalar>::MatrixX DavidsonSolverT<Scalar>::_restart_coefficients(MatrixX &U, MatrixX &U_prev, int nkeep) const
+{
+    /* Coefficients of the restarted basis in the current search space :
+
+    Y = [ U(:,:nkeep) , U_prev(:,:nprev) ]
+
+    where U_prev holds the Ritz vectors of the previous iteration (GD+k)
+    padded with zeros. The columns of Y are orthonormal.
+
+    */
+
+    int nprev = std::min(this->restart_previous,static_cast<int>(U_prev.cols()));
+    MatrixX Y = MatrixX::Zero(U.rows(),nkeep+nprev);
+    Y.leftCols(nkeep) = U.leftCols(nkeep);
+    if (nprev > 0) {
+        Y.block(0,nkeep,U_prev.rows(),nprev) = U_prev.leftCols(nprev);
+        DavidsonSolverT::_gramschmidt(Y,nkeep);
+    }
+    return Y;
+}
 
+template class DavidsonSolverT<float>;
+template class DavidsonSolverT<double>;
+template class DavidsonSolverT<std::complex<float>>;
+template class DavidsonSolverT<std::complex<double>>;
@@ -1,46 +1,268 @@
 #include <iostream>
 #include <Eigen/Dense>
 #include <Eigen/Core>
+#include <Eigen/IterativeLinearSolvers>
+#include <unsupported/Eigen/IterativeSolvers>
+#include <chrono>
+#include <limits>
+#include <type_traits>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <functional>
+
+#include "MatrixFreeOperator.hpp"
+#include "Preconditioner.hpp"
+#include "JacobiDavidsonOperator.hpp"
+#include "DavidsonWorkspace.hpp"
+#include "DavidsonStatistics.hpp"
 
 #ifndef _DAVIDSON_SOLVER_
 #define _DAVIDSON_SOLVER_
 
-class DavidsonSolver
+// operator used by the single precision iterations of the mixed precision mode
+// matrix free operators are used as they are (apply_single), Eigen matrices are rounded
+template<typename MatrixReplacement, bool = IsMatrixFreeOperator<MatrixReplacement>::value>
+struct SinglePrecisionOperator
+{
+	typedef typename SinglePrecision<typename MatrixReplacement::Scalar>::type SingleScalar;
+	typedef typename std::decay<decltype(std::declval<MatrixReplacement>().template cast<SingleScalar>().eval())>::type type;
+	static type convert(const MatrixReplacement &A) {return A.template cast<SingleScalar>();}
+};
+
+template<typename MatrixReplacement>
+struct SinglePrecisionOperator<MatrixReplacement,true>
+{
+	typedef const MatrixReplacement& type;
+	static type convert(const MatrixReplacement &A) {return A;}
+};
+
+// cancellation token shared between a solver and its controller
+// the solver checks it between iterations and then returns its current Ritz pairs
+class DavidsonCancellation
+{
+	public:
+
+		DavidsonCancellation() : _flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+		void cancel() {_flag->store(true);}
+		void reset() {_flag->store(false);}
+		bool cancelled() const {return _flag->load();}
+
+	private:
+
+		std::shared_ptr<std::atomic<bool>> _flag;
+};
+
+// called at the end of each iteration with the state of the iteration and
+// the residue norms and eigenvalue changes of the roots
+typedef std::function<void(const DavidsonIteration &, const Eigen::ArrayXd &, const Eigen::ArrayXd &)> DavidsonObserver;
+
+// Davidson solver for symmetric (Hermitian) operators working with Scalar :
+// float, double, std::complex<float> or std::complex<double>
+// the eigenvalues are real in all cases
+template<typename Scalar>
+class DavidsonSolverT
 {
 
 	public:
 
-		DavidsonSolver();
+		typedef typename Eigen::NumTraits<Scalar>::Real RealScalar;
+		typedef typename SinglePrecision<Scalar>::type SingleScalar;
+		typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+		typedef Eigen::Matrix<Scalar,Eigen::Dynamic,1> VectorX;
+		typedef Eigen::Matrix<RealScalar,Eigen::Dynamic,1> RealVectorX;
+
+		DavidsonSolverT();
 
 		void set_iter_max(int N) { this->iter_max = N; }
 		void set_tolerance(double eps) { this->tol = eps; }
 		void set_max_search_space(int N) { this->max_search_space = N;}
+		void set_restart_size(int N) { this->restart_size = N;}
+		void set_restart_previous(int N) { this->restart_previous = N;}
 		void set_initial_guess_size(int N) {this->size_initial_guess=N;}
 		void set_linsolve_tol(double tol){this->linsolve_tol=tol;}
 		void set_guess_vectors(std::string method){this->guess_vectors=method;} 
+		void set_num_threads(int N) {this->num_threads = N;}
+
+		// warm start : the columns of X (e.g. the eigenvectors of a previous,
+		// slightly different problem) are orthonormalized and completed by
+		// the guess vectors of set_guess_vectors up to the initial guess size
+		// the guess is kept for the next calls to solve() until cleared
+		void set_initial_guess(const MatrixX &X) {this->initial_guess = X;}
+		void clear_initial_guess() {this->initial_guess.resize(0,0);}
+
+		// checkpoints : the state of the iterations is written to filename
+		// every N iterations and when iter_max is reached without convergence
+		void set_checkpoint(std::string filename, int N = 10) {this->checkpoint_file = filename; this->checkpoint_every = N;}
+
+		// the next call to solve() resumes the iterations of a checkpoint
+		// written with the same problem and the same settings
+		void set_resume(std::string filename) {this->resume_file = filename;}
+
+		// keep the current Ritz pairs instead of zeros when the
+		// iterations don't converge
+		void set_return_unconverged(bool flag) {this->return_unconverged = flag;}
+
+		// out of core search space : V, AV (and BV) are stored in a
+		// memory-mapped temporary file of directory ("" : in memory)
+		void set_out_of_core(std::string directory) {this->out_of_core_directory = directory;}
+
+		// mixed precision : single precision iterations until the residual
+		// reaches mixed_precision_tol (0 : close to the float round-off),
+		// then iterations in the precision of Scalar
+		void set_mixed_precision(bool flag) {this->mixed_precision = flag;}
+		void set_mixed_precision_tol(double eps) {this->mixed_precision_tol = eps;}
+
+		// target mode : eigenvalues closest to sigma instead of the lowest ones
+		// they are extracted with harmonic Ritz values (Ritz values closest
+		// to sigma for the generalized problem) and returned by distance to sigma
+		void set_target(double sigma) {this->target = true; this->sigma = sigma;}
 
 		void set_correction(std::string method); 
 		void set_jacobi_linsolve(std::string method);
+		void set_orthogonalization(std::string method);
 
-		Eigen::VectorXd eigenvalues() const {return this->_eigenvalues;}
-		Eigen::MatrixXd eigenvectors() const {return this->_eigenvectors;}
+		// preconditioner of the DPR and Olsen corrections :
+		// DIAGONAL, or CLAMPED to keep the denominators above 1E-3
+		void set_preconditioner(std::string method);
+
+		// user preconditioner (e.g. BlockDiagonalPreconditionerT), it is
+		// not copied and must outlive the calls to solve()
+		void set_preconditioner(const PreconditionerT<Scalar> &M) {this->preconditioner = &M;}
+
+		// messages of the solver (banner, iterations, summary), the solver
+		// is silent by default and set_verbose(true) prints to std::cout
+		void set_log_sink(DavidsonLogSink sink) {this->log_sink = sink;}
+		void set_verbose(bool flag);
+
+		RealVectorX eigenvalues() const {return this->_eigenvalues;}
+		MatrixX eigenvectors() const {return this->_eigenvectors;}
+
+		// counters and timers per phase, and the iterations of the last solve
+		const DavidsonStatistics& statistics() const {return this->_stats;}
+
+		// observer of the iterations, it is called from the solving thread
+		void set_observer(DavidsonObserver observer) {this->observer = observer;}
+
+		// a cancelled solve stops between two iterations, it keeps the
+		// current Ritz pairs and cancelled() is true
+		void set_cancellation(DavidsonCancellation token) {this->cancellation = token; this->has_cancellation = true;}
+		bool cancelled() const {return this->_cancelled;}
+
+		// iterations and products of the operator with a vector done by the
+		// last solve (the single precision ones of the mixed precision mode
+		// included, the inner iterations of CG/GMRES count as products)
+		int iterations() const {return this->_iterations;}
+		bool converged() const {return this->_converged;}
+		long matvecs() const {return this->_stats.apply.count;}
 
 
 
 		template <typename MatrixReplacement>
 		void solve(MatrixReplacement &A, int neigen, int size_initial_guess = 0)
 		{
+		    DavidsonSolverT::_solve<MatrixReplacement,MatrixReplacement>(A,nullptr,neigen,size_initial_guess);
+		}
+
+		// generalized problem A x = lambda B x, with B positive definite
+		// the eigenvectors are B-orthonormal
+		template <typename MatrixReplacement, typename MatrixReplacementB>
+		typename std::enable_if<!std::is_arithmetic<MatrixReplacementB>::value>::type
+		solve(MatrixReplacement &A, MatrixReplacementB &B, int neigen, int size_initial_guess = 0)
+		{
+		    DavidsonSolverT::_solve<MatrixReplacement,MatrixReplacementB>(A,&B,neigen,size_initial_guess);
+		}
+
+		// solve in another thread, the exceptions are rethrown by get()
+		// the solver and the operator must outlive the future and the
+		// solver must not be used before get() returns
+		template <typename MatrixReplacement>
+		std::future<void> solve_async(MatrixReplacement &A, int neigen, int size_initial_guess = 0)
+		{
+		    return std::async(std::launch::async,[this,&A,neigen,size_initial_guess]() {
+		        this->solve(A,neigen,size_initial_guess);
+		    });
+		}
+
 
-		    std::cout << std::endl;
-		    std::cout << "===========================" << std::endl; 
-		    if(this->correction == CORR::JACOBI)  std::cout << "= Jacobi-Davidson  : " << this->jacobi_linsolve <<  std::endl; 
+	private :
+
+		template<typename> friend class DavidsonSolverT;
+		template<typename> friend class DavidsonBatchT;
+
+		int iter_max = 1000;
+		double tol = 1E-6;
+		int max_search_space = 0;
+		int restart_size = 0;
+		int restart_previous = 0;
+		int size_initial_guess = 0;
+		double linsolve_tol = 1E-3;
+		int num_threads = 0;
+		bool mixed_precision = false;
+		double mixed_precision_tol = 0;
+		bool target = false;
+		double sigma = 0;
+
+		// residue norm above which the corrections use sigma instead of the Ritz value
+		double target_shift_tol = 1E-2;
+
+		std::string guess_vectors = "target";
+		MatrixX initial_guess;
+		std::string checkpoint_file;
+		int checkpoint_every = 10;
+		std::string resume_file;
+		bool return_unconverged = false;
+		std::string out_of_core_directory;
+		DavidsonLogSink log_sink;
+		DavidsonObserver observer;
+		DavidsonCancellation cancellation;
+		bool has_cancellation = false;
+		enum CORR {DPR,JACOBI,OLSEN};
+		enum LSOLVE {CG,GMRES,LLT};
+		enum ORTHO {GS,QR,BCGS2};
+		enum PRECOND {DIAGONAL,CLAMPED};
+		
+		CORR correction = CORR::DPR;
+		LSOLVE jacobi_linsolve = LSOLVE::CG;
+		ORTHO orthogonalization = ORTHO::BCGS2;
+		PRECOND preconditioning = PRECOND::DIAGONAL;
+
+		// smallest denominator of the CLAMPED preconditioner
+		double precond_clamp = 1E-3;
+
+		// user preconditioner, used instead of the diagonal ones when set
+		const PreconditionerT<Scalar> *preconditioner = nullptr;
+
+		// relative norm below which a correction is considered dependent
+		double orth_tol = Eigen::NumTraits<RealScalar>::dummy_precision();
+
+		// standard (B == nullptr) and generalized problems
+		template <typename MatrixReplacement, typename MatrixReplacementB>
+		void _solve(MatrixReplacement &A, MatrixReplacementB *B, int neigen, int size_initial_guess)
+		{
+
+		    DavidsonSolverT::_log("\n===========================\n");
+		    if(this->correction == CORR::JACOBI)  DavidsonSolverT::_log("= Jacobi-Davidson  : %d\n",this->jacobi_linsolve);
 		    
-		    else if (this->correction == CORR::OLSEN)  std::cout << "= Olsen-Davidson  : " <<  std::endl;    
+		    else if (this->correction == CORR::OLSEN)  DavidsonSolverT::_log("= Olsen-Davidson  : \n");
 		    
-		    else  std::cout << "= Davidson (DPR)" <<  std::endl; 
+		    else  DavidsonSolverT::_log("= Davidson (DPR)\n");
+
+		    if (this->mixed_precision) DavidsonSolverT::_log("= mixed precision\n");
+
+		    DavidsonSolverT::_log("===========================\n\n");
+
+		    // number of threads used by the operator and the dense kernels
+		    DavidsonSolverT::_set_num_threads();
+		    this->_iterations = 0;
+		    this->_stats.clear();
+		    this->_cancelled = false;
+		    std::chrono::steady_clock::time_point solve_start = std::chrono::steady_clock::now();
 
-		    std::cout << "===========================" << std::endl;
-		    std::cout << std::endl;
+		    bool generalized = (B != nullptr);
+		    if (generalized and this->correction == CORR::JACOBI)
+		        throw std::runtime_error("Jacobi-Davidson correction not available for the generalized problem");
 
 		    //double res_norm;
 		    Eigen::ArrayXd res_norm = Eigen::ArrayXd::Zero(neigen);
@@ -56,209 +278,504 @@ class DavidsonSolver
 		    		size_initial_guess = 10;
 		    }
 		    int search_space = size_initial_guess;
-		    max_search_space = 2*size_initial_guess;
 
-		    // initialize the guess eigenvector
-		    Eigen::VectorXd Adiag = A.diagonal();    
-		    Eigen::MatrixXd V = DavidsonSolver::_get_initial_eigenvectors(Adiag,size_initial_guess);
-		    
-
-		    Eigen::VectorXd lambda; // eigenvalues hodlers
-		    Eigen::VectorXd old_val = Eigen::VectorXd::Zero(neigen);
+		    // number of Ritz vectors kept at restart
+		    int nkeep = std::max(this->restart_size,neigen);
+
+		    // max search space : 2*size_initial_guess unless specified
+		    // it must hold the initial guess, the restart vectors and one set of corrections
+		    int max_space = this->max_search_space;
+		    if (max_space == 0) max_space = 2*size_initial_guess;
+		    max_space = std::max(max_space,nkeep+this->restart_previous+neigen);
+		    max_space = std::max(max_space,size_initial_guess);
+
+		    // preallocate the search space with room for one set of corrections
+		    // the products with V and AV stream through them in panels of rows
+		    // (the depth blocking of the Eigen products) so that an out of
+		    // core search space is read sequentially
+		    DavidsonWorkspace<Scalar> &ws = this->_workspace;
+		    ws.set_out_of_core(this->out_of_core_directory);
+		    bool harmonic = this->target and !generalized;
+		    ws.allocate(size,max_space+neigen,std::max(nkeep+this->restart_previous,neigen),generalized,harmonic);
+
+		    // diagonals used by the preconditioners : diag(A) - lambda diag(B)
+		    // diag(B) is one for the standard problem
+		    VectorX Adiag = A.diagonal().template cast<Scalar>();
+		    VectorX Bdiag = VectorX::Ones(size);
+		    if (generalized) Bdiag = B->diagonal().template cast<Scalar>();
+		    VectorX D = Adiag.cwiseQuotient(Bdiag);
+
+		    // preconditioner of the DPR and Olsen corrections
+		    std::unique_ptr<PreconditionerT<Scalar>> diagonal_preconditioner;
+		    if (this->preconditioning == PRECOND::CLAMPED)
+		        diagonal_preconditioner.reset(new ClampedDiagonalPreconditionerT<Scalar>(Adiag,Bdiag,this->precond_clamp));
+		    else
+		        diagonal_preconditioner.reset(new DiagonalPreconditionerT<Scalar>(Adiag,Bdiag));
+		    const PreconditionerT<Scalar> *M = this->preconditioner ? this->preconditioner : diagonal_preconditioner.get();
+
+		    RealVectorX lambda; // eigenvalues hodlers
+		    RealVectorX old_val = RealVectorX::Zero(neigen);
 		    
 		    // temp varialbes 
-		    Eigen::MatrixXd T, U, q;
-		    Eigen::VectorXd w, tmp;
-		    
+		    MatrixX U, U_prev;
+		    VectorX r(size), x(size);
+		    Eigen::SelfAdjointEigenSolver<MatrixX> es(ws.capacity());
+
+		    // state of the iterations saved in the checkpoints
+		    typename DavidsonWorkspace<Scalar>::State state;
+		    state.generalized = generalized;
+		    state.harmonic = harmonic;
+		    state.root_converged = root_converged;
+		    int nvec = 0;
+		    int iter_start = 0;
+
+		    // resume from a checkpoint : the search space and its projections
+		    // are read back, the resume file is only used once
+		    if (!this->resume_file.empty()) {
+		        ws.read_checkpoint(this->resume_file,state);
+		        this->resume_file.clear();
+		        iter_start = state.iteration;
+		        nvec = state.nvec;
+		        search_space = state.search_space;
+		        root_converged = state.root_converged;
+		        old_val = state.old_val;
+		        U_prev = state.U_prev;
+		    }
 
-		    // project the matrix on the trial subspace
-		    T = A * V;
-		    T = V.transpose()*T;
+		    else {
+
+		        // initialize the guess eigenvector
+		        // in mixed precision they come from the single precision iterations
+		        // and a user guess completes the usual guess vectors
+		        if (this->initial_guess.size() > 0 and this->initial_guess.rows() != size)
+		            throw std::runtime_error("Not a valid initial guess");
+		        MatrixX guess;
+		        if (this->mixed_precision and !std::is_same<Scalar,SingleScalar>::value)
+		            guess = DavidsonSolverT::_single_precision_guess<MatrixReplacement,MatrixReplacementB>(A,B,D,neigen,size_initial_guess);
+		        else if (this->initial_guess.size() > 0)
+		            guess = DavidsonSolverT::_complete_guess(this->initial_guess,D,size_initial_guess);
+		        else
+		            guess = DavidsonSolverT::_get_initial_eigenvectors(D,size_initial_guess);
+		        nvec = guess.cols();
+		        ws.V.leftCols(nvec) = guess;
+
+		        // the basis of the generalized problem is B-orthonormal
+		        if (generalized) nvec = DavidsonSolverT::_b_orthonormalize<MatrixReplacementB>(ws,*B,0,nvec);
 
-		    printf("iter\tSearch Space\tNorm/%.0e\n",tol);
-		    std::cout << "-----------------------------------" << std::endl;
-		    for (int iiter = 0; iiter < iter_max; iiter ++ )
+		        // project the matrix on the trial subspace
+		        // AV is kept along V so that A is only applied to new vectors
+		        {
+		            DavidsonTimer timer(this->_stats.apply,nvec);
+		            OperatorProduct<MatrixReplacement,Scalar>::apply(A,ws.V.leftCols(nvec),ws.AV.leftCols(nvec));
+		        }
+		        ws.T.topLeftCorner(nvec,nvec).noalias() = ws.V.leftCols(nvec).adjoint()*ws.AV.leftCols(nvec);
+		        if (harmonic) ws.AVtAV.topLeftCorner(nvec,nvec).noalias() = ws.AV.leftCols(nvec).adjoint()*ws.AV.leftCols(nvec);
+		    }
+
+		    DavidsonSolverT::_log("iter\tSearch Space\tNorm/%.0e\n",tol);
+		    DavidsonSolverT::_log("-----------------------------------\n");
+		    for (int iiter = iter_start; iiter < iter_max; iiter ++ )
 		    {
+		        this->_iterations++;
 		        
-		        // std::cout << "\nT:\n" << T << std::endl;
 		        // diagonalize the small subspace
-		        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(T);
-		        lambda = es.eigenvalues();
-		        U = es.eigenvectors();
+		        // the Ritz vectors are sorted by distance to sigma in target mode
+		        {
+		            DavidsonTimer timer(this->_stats.subspace);
+		            if (harmonic) DavidsonSolverT::_harmonic_ritz(ws,nvec,lambda,U);
+		            else {
+		                es.compute(ws.T.topLeftCorner(nvec,nvec));
+		                lambda = es.eigenvalues();
+		                U = es.eigenvectors();
+		                if (this->target) DavidsonSolverT::_sort_by_target(lambda,U,(lambda.array()-RealScalar(this->sigma)).abs().matrix());
+		            }
+		        }
 
-		        // Ritz eigenvectors
-		        q = V*U.block(0,0,U.rows(),neigen);
+		        // Ritz eigenvectors and their product with A
+		        ws.ritz.leftCols(neigen).noalias() = ws.V.leftCols(nvec)*U.leftCols(neigen);
+		        ws.Aritz.leftCols(neigen).noalias() = ws.AV.leftCols(nvec)*U.leftCols(neigen);
+		        if (generalized) ws.Britz.leftCols(neigen).noalias() = ws.BV.leftCols(nvec)*U.leftCols(neigen);
 
 		        // residue and correction vectors
+		        // the corrections are written directly after the search space
+		        DavidsonTimer correction_timer(this->_stats.correction);
+		        int nnew = 0;
+		        RealVectorX shifts(neigen);
 		        for (int j=0; j<neigen; j++) {   
 
-		        	// (not root_converged[j]) {
-
-			            // residue vector
-			            w = A*q.col(j) - lambda(j)*q.col(j);
-			            res_norm[j] = w.norm();
-
-			            // jacobi-davidson correction
-			            if (this->correction == CORR::JACOBI) {
-			                tmp = q.col(j);
-			                w = DavidsonSolver::_jacobi_correction<MatrixReplacement>(A,w,tmp,lambda(j));
-			            }
-
-			            else if (this->correction == CORR::OLSEN) {
-			            	tmp = q.col(j);
-			                w = DavidsonSolver::_olsen_correction(w,tmp,Adiag,lambda(j));
-			            }
-			            
-			            // Davidson DPR
-			            else  {
-			                w = DavidsonSolver::_dpr_correction(w,Adiag,lambda(j));
-			            }
-
-			            // append the correction vector to the search space
-			            V.conservativeResize(Eigen::NoChange,V.cols()+1);
-			            V.col(V.cols()-1) = w.normalized();
-
-			            // check the root
-			            root_converged[j] = res_norm[j] < tol;
-			        //}
-		            
+		            // converged roots are locked : their Ritz vectors stay in
+		            // the search space but they don't produce corrections anymore
+		            if (root_converged[j]) continue;
+
+		            // residue vector : A x - lambda B x
+		            auto w = ws.V.col(nvec+nnew);
+		            auto Bx = generalized ? ws.Britz.col(j) : ws.ritz.col(j);
+		            w = ws.Aritz.col(j) - lambda(j)*Bx;
+		            res_norm[j] = w.norm();
+
+		            // check the root
+		            root_converged[j] = res_norm[j] < tol;
+		            if (root_converged[j]) continue;
+
+		            // in target mode the corrections are built around sigma
+		            // until the Ritz value is accurate enough
+		            RealScalar shift = lambda(j);
+		            if (this->target and res_norm[j] > this->target_shift_tol) shift = this->sigma;
+
+		            // jacobi-davidson correction, one root at a time
+		            if (this->correction == CORR::JACOBI) {
+		                r = w;
+		                x = ws.ritz.col(j);
+		                w = DavidsonSolverT::_jacobi_correction<MatrixReplacement>(A,r,x,shift);
+		            }
+
+		            // the DPR and Olsen corrections are done on the whole block
+		            else if (this->correction == CORR::OLSEN) {
+		                ws.scratch.col(nnew) = Bx;
+		            }
+
+		            shifts(nnew) = shift;
+		            nnew++;
 		        }
 
+		        // preconditioned block of corrections
+		        auto W = ws.V.middleCols(nvec,nnew);
+		        if (this->correction == CORR::OLSEN)
+		            DavidsonSolverT::_olsen_correction(*M,W,ws.scratch.leftCols(nnew),shifts.head(nnew));
+		        else if (this->correction == CORR::DPR)
+		            DavidsonSolverT::_dpr_correction(*M,W,shifts.head(nnew));
+
+		        // the correction vectors are now part of the search space
+		        W.colwise().normalize();
+		        this->_stats.correction.count += nnew;
+		        correction_timer.stop();
+
 		        // eigenvalue norm
-		        lambda_conv = (lambda.head(neigen)-old_val).array().abs();
-		        printf("%4d\t%12d\t%4.2e\t%4.2e\t%4.1f%% converged\n", iiter,search_space,res_norm.maxCoeff(),lambda_conv.maxCoeff(),100*root_converged.sum()/neigen);
+		        lambda_conv = (lambda.head(neigen)-old_val).array().abs().template cast<double>();
+		        DavidsonSolverT::_log("%4d\t%12d\t%4.2e\t%4.2e\t%4.1f%% converged\n", iiter,search_space,res_norm.maxCoeff(),lambda_conv.maxCoeff(),100*root_converged.sum()/neigen);
+
+		        DavidsonIteration record;
+		        record.iteration = iiter;
+		        record.search_space = search_space;
+		        record.converged = root_converged.sum();
+		        record.residue_norm = res_norm.maxCoeff();
+		        record.eigenvalue_change = lambda_conv.maxCoeff();
+		        record.time = std::chrono::duration<double>(std::chrono::steady_clock::now()-solve_start).count();
+		        this->_stats.history.push_back(record);
+		        if (this->observer) this->observer(record,res_norm,lambda_conv);
 
 		        // update 
-		        search_space = V.cols();
+		        search_space = nvec+nnew;
 		        old_val = lambda.head(neigen);
 		        		       
 		        // break if converged, update otherwise
-		        if((res_norm<tol).all()) {
+		        if(root_converged.all()) {
 		        //if((lambda_conv<tol).all()) {
 		            has_converged = true;
 		            break;
 		        }
 
+		        // stop a cancelled solve with the current Ritz pairs
+		        if (this->has_cancellation and this->cancellation.cancelled()) {
+		            this->_cancelled = true;
+		            DavidsonSolverT::_log("- cancelled\n");
+		            break;
+		        }
+
 		        // check if we need to restart
-		        if (search_space > max_search_space or search_space > size )
+		        DavidsonTimer orthogonalization_timer(this->_stats.orthogonalization);
+		        bool restart = (search_space > max_space or search_space > size);
+		        if (restart)
 		        {
-
-		            V = q.block(0,0,V.rows(),neigen);
-		            for (int j=0; j<neigen; j++) {
-		                V.col(j) = V.col(j).normalized();
+		            // thick restart : the old part of the search space is
+		            // compressed to the nkeep lowest Ritz vectors (and the
+		            // Ritz vectors of the previous iteration for GD+k)
+		            // AV and T are rotated with them : no product with A is needed
+		            MatrixX Y = DavidsonSolverT::_restart_coefficients(U,U_prev,std::min(std::min(nkeep,size-nnew),nvec));
+		            int nrestart = Y.cols();
+
+		            // the harmonic Ritz vectors are not orthogonal
+		            if (harmonic) DavidsonSolverT::_gramschmidt(Y,0);
+
+		            ws.scratch.leftCols(nrestart).noalias() = ws.V.leftCols(nvec)*Y;
+		            ws.V.leftCols(nrestart) = ws.scratch.leftCols(nrestart);
+		            ws.scratch.leftCols(nrestart).noalias() = ws.AV.leftCols(nvec)*Y;
+		            ws.AV.leftCols(nrestart) = ws.scratch.leftCols(nrestart);
+		            if (generalized) {
+		                ws.scratch.leftCols(nrestart).noalias() = ws.BV.leftCols(nvec)*Y;
+		                ws.BV.leftCols(nrestart) = ws.scratch.leftCols(nrestart);
 		            }
-		            search_space = neigen;
+		            ws.T.topLeftCorner(nrestart,nrestart) = Y.adjoint()*ws.T.topLeftCorner(nvec,nvec)*Y;
+		            if (harmonic) ws.AVtAV.topLeftCorner(nrestart,nrestart) = Y.adjoint()*ws.AVtAV.topLeftCorner(nvec,nvec)*Y;
 
-		            // recompute the projected matrix
-		            T = V.transpose()*(A * V);
+		            // move the corrections after the restarted basis
+		            for (int k=0; k<nnew; k++) {
+		                ws.V.col(nrestart+k) = ws.V.col(nvec+k);
+		            }
+		            nvec = nrestart;
 		        }
 
-		        // continue otherwise
-		        else
-		        {
-		            // orthogonalize the V vectors
-		            //V = DavidsonSolver::_QR(V);
-		            V = DavidsonSolver::_gramschmidt(V,V.cols()-neigen);
-		            
-		            // update the T matrix : avoid recomputing V.T A V 
-		            // just recompute the element relative to the new eigenvectors
-		            DavidsonSolver::_update_projected_matrix<MatrixReplacement>(T,A,V);
-		            
+		        // orthogonalize the new vectors
+		        // dependent corrections may be dropped
+		        if (generalized) nnew = DavidsonSolverT::_b_orthonormalize<MatrixReplacementB>(ws,*B,nvec,nnew);
+		        else nnew = DavidsonSolverT::_orthogonalize(ws.V.leftCols(nvec+nnew),nvec);
+		        orthogonalization_timer.stop();
+		        
+		        // update the T matrix : avoid recomputing V.T A V 
+		        // just recompute the element relative to the new eigenvectors
+		        DavidsonSolverT::_update_projected_matrix<MatrixReplacement>(ws,A,nvec,nnew,harmonic);
+		        nvec += nnew;
+
+		        // Ritz vectors kept for the next restart (in the current basis)
+		        if (restart) U_prev.resize(0,0);
+		        else U_prev = U.leftCols(std::min(this->restart_previous,static_cast<int>(U.cols())));
+
+		        // write the state of the iterations
+		        if (!this->checkpoint_file.empty() and ((iiter+1) % this->checkpoint_every == 0 or iiter+1 == iter_max)) {
+		            state.iteration = iiter+1;
+		            state.nvec = nvec;
+		            state.search_space = search_space;
+		            state.root_converged = root_converged;
+		            state.old_val = old_val;
+		            state.U_prev = U_prev;
+		            ws.write_checkpoint(this->checkpoint_file,state);
 		        }
 		        
 		    }
 
 		    // store the eigenvalues/eigenvectors
 		    this->_eigenvalues = lambda.head(neigen);
-		    this->_eigenvectors = q.block(0,0,q.rows(),neigen);
+		    this->_eigenvectors = ws.ritz.leftCols(neigen);
 
 		    // normalize the eigenvectors
-		    for (int i=0; i<neigen; i++){
+		    // (they are B-normalized already for the generalized problem)
+		    for (int i=0; i<neigen and !generalized; i++){
 		        this->_eigenvectors.col(i).normalize();
 		    }
 
-		    std::cout << "-----------------------------------" << std::endl;
+		    this->_converged = has_converged;
+		    DavidsonSolverT::_log("-----------------------------------\n");
 		    if (!has_converged) {
-		        std::cout << "- Warning : Davidson didn't converge ! " <<  std::endl; 
-		        this->_eigenvalues = Eigen::VectorXd::Zero(neigen);
-		        this->_eigenvectors = Eigen::MatrixXd::Zero(size,neigen);
+		        DavidsonSolverT::_log("- Warning : Davidson didn't converge ! \n");
+		        if (!this->return_unconverged and !this->_cancelled) {
+		            this->_eigenvalues = RealVectorX::Zero(neigen);
+		            this->_eigenvectors = MatrixX::Zero(size,neigen);
+		        }
 		    }
 		    else   {
-		        std::cout << "- Davidson converged " <<  std::endl; 
-		        printf("- final residue norm %4.2e\n",res_norm.maxCoeff());
-		        printf("- final eigenvalue norm %4.2e\n",lambda_conv.maxCoeff());
+		        DavidsonSolverT::_log("- Davidson converged \n");
+		        DavidsonSolverT::_log("- final residue norm %4.2e\n",res_norm.maxCoeff());
+		        DavidsonSolverT::_log("- final eigenvalue norm %4.2e\n",lambda_conv.maxCoeff());
 		    }
-		    std::cout << "-----------------------------------" << std::endl;
+		    DavidsonSolverT::_log("-----------------------------------\n");
 		    
 		}
 
 
-	private :
 
-		int iter_max = 1000;
-		double tol = 1E-6;
-		int max_search_space = 100;
-		int size_initial_guess = 0;
-		double linsolve_tol = 1E-3;
 
-		std::string guess_vectors = "target";
-		enum CORR {DPR,JACOBI,OLSEN};
-		enum LSOLVE {CG,GMRES,LLT};
-		
-		CORR correction = CORR::DPR;
-		LSOLVE jacobi_linsolve = LSOLVE::CG;
+		RealVectorX _eigenvalues;
+		MatrixX _eigenvectors; 
+
+		mutable int _iterations = 0;
+		bool _converged = false;
+		bool _cancelled = false;
+		mutable DavidsonStatistics _stats;
 
+		DavidsonWorkspace<Scalar> _workspace;
 
+		template<typename Other>
+		void _copy_settings(const DavidsonSolverT<Other> &other);
 
-		Eigen::VectorXd _eigenvalues;
-		Eigen::MatrixXd _eigenvectors; 
+		void _set_num_threads() const;
+		void _log(const char *format, ...) const;
+		Eigen::ArrayXd _sort_index(RealVectorX &V) const;
+		MatrixX _get_initial_eigenvectors(VectorX &D, int size ) const;
+		MatrixX _complete_guess(const MatrixX &X, VectorX &D, int size) const;
+		MatrixX _solve_linear_system(MatrixX &A, VectorX &b) const; 
+		MatrixX _QR(MatrixX &A) const;
+		void _gramschmidt( Eigen::Ref<MatrixX> Q, int nstart ) const;
+		int _orthogonalize( Eigen::Ref<MatrixX> Q, int nstart ) const;
+		int _block_gramschmidt( Eigen::Ref<MatrixX> Q, int nstart ) const;
+		int _block_QR( Eigen::Ref<MatrixX> Q, int nstart ) const;
+		void _project_out( Eigen::Ref<MatrixX> Q, int nstart ) const;
+		MatrixX _restart_coefficients(MatrixX &U, MatrixX &U_prev, int nkeep) const;
 
-		Eigen::ArrayXd _sort_index(Eigen::VectorXd &V) const;
-		Eigen::MatrixXd _get_initial_eigenvectors(Eigen::VectorXd &D, int size ) const;
-		Eigen::MatrixXd _solve_linear_system(Eigen::MatrixXd &A, Eigen::VectorXd &b) const; 
-		Eigen::MatrixXd _QR(Eigen::MatrixXd &A) const;
-		Eigen::MatrixXd _gramschmidt( Eigen::MatrixXd &A, int nstart ) const;
+		template <typename MatrixReplacement, typename MatrixReplacementB>
+		MatrixX _single_precision_guess(MatrixReplacement &A, MatrixReplacementB *B, VectorX &D, int neigen, int size_initial_guess) const
+		{
+		    // single precision iterations up to a tolerance close to the
+		    // float round-off (the residual can't go much below eps * |A|)
+		    DavidsonSolverT<SingleScalar> single;
+		    single._copy_settings(*this);
+		    single.mixed_precision = false;
+		    double tol_single = this->mixed_precision_tol;
+		    if (tol_single == 0) tol_single = 1E2 * std::numeric_limits<float>::epsilon() * D.cwiseAbs().maxCoeff();
+		    single.tol = std::max(this->tol,tol_single);
+
+		    typename SinglePrecisionOperator<MatrixReplacement>::type As = SinglePrecisionOperator<MatrixReplacement>::convert(A);
+		    if (B) {
+		        typename SinglePrecisionOperator<MatrixReplacementB>::type Bs = SinglePrecisionOperator<MatrixReplacementB>::convert(*B);
+		        single.solve(As,Bs,neigen,size_initial_guess);
+		    }
+		    else single.solve(As,neigen,size_initial_guess);
+		    this->_iterations += single._iterations;
+		    this->_stats.add_phases(single._stats);
+
+		    // the Ritz vectors are used even if the single precision iterations
+		    // didn't reach their tolerance : they are still a good guess
+		    MatrixX X = single._workspace.ritz.leftCols(neigen).template cast<Scalar>();
+		    return DavidsonSolverT::_complete_guess(X,D,size_initial_guess);
+		}
 
 		template <typename MatrixReplacement>
-		Eigen::MatrixXd _jacobi_correction(MatrixReplacement &A, Eigen::VectorXd &r, Eigen::VectorXd &u, double lambda) const
+		MatrixX _jacobi_correction(MatrixReplacement &A, VectorX &r, VectorX &u, RealScalar lambda) const
 		{
 
-			std::chrono::time_point<std::chrono::system_clock> start, end;
-    		std::chrono::duration<double> elapsed_time;
+		    // CG and GMRES only need the product of the projected matrix with a vector
+		    // P * (A - lambda*I) * P^T is therefore never formed
+		    if (this->jacobi_linsolve != LSOLVE::LLT) {
+		        JacobiDavidsonOperator<MatrixReplacement,Scalar> projA(A,u,lambda);
+		        return DavidsonSolverT::_solve_projected_system<MatrixReplacement>(projA,r);
+		    }
 
-    		start = std::chrono::system_clock::now();
-		    // form the projector  P = I -u * u.T
-		    Eigen::MatrixXd P = -u*u.transpose();
-		    P.diagonal().array() += 1.0;
+		    // form the projector  P = I -u * u.H
+		    MatrixX P = -u*u.adjoint();
+		    P.diagonal().array() += Scalar(1);
 
-		    // project the matrix P * (A - lambda*I) * P^T
-		    Eigen::MatrixXd projA = A*P.transpose();
-		    projA -= lambda*P.transpose();
+		    // project the matrix P * (A - lambda*I) * P^H
+		    MatrixX projA(P.rows(),P.rows());
+		    {
+		        DavidsonTimer timer(this->_stats.apply,P.rows());
+		        OperatorProduct<MatrixReplacement,Scalar>::apply(A,P.adjoint(),projA);
+		    }
+		    projA -= lambda*P.adjoint();
 		    projA = P * projA;
-		    end = std::chrono::system_clock::now();
-		    elapsed_time = end-start;
-		    std::cout << "_ form linear system " << this->jacobi_linsolve << " in " << elapsed_time.count() << " secs" <<  std::endl;
-		    return DavidsonSolver::_solve_linear_system(projA,r);
+		    return DavidsonSolverT::_solve_linear_system(projA,r);
 		}
 
-		Eigen::VectorXd _dpr_correction(Eigen::VectorXd &w, Eigen::VectorXd &A0, double lambda) const;
-		Eigen::VectorXd _olsen_correction(Eigen::VectorXd &r, Eigen::VectorXd &x, Eigen::VectorXd &D, double lambda) const;
+		template <typename MatrixReplacement>
+		VectorX _solve_projected_system(JacobiDavidsonOperator<MatrixReplacement,Scalar> &projA, VectorX &r) const
+		{
+		    VectorX w;
+		    DavidsonTimer timer(this->_stats.linsolve);
+		    if (this->jacobi_linsolve == LSOLVE::CG) {
+		        Eigen::ConjugateGradient<JacobiDavidsonOperator<MatrixReplacement,Scalar>, Eigen::Lower|Eigen::Upper, Eigen::IdentityPreconditioner> cg;
+		        cg.setTolerance(this->linsolve_tol);
+		        cg.compute(projA);
+		        w = cg.solve(r);
+		        this->_stats.linsolve.count += cg.iterations();
+		        this->_stats.apply.count += cg.iterations() + 1;
+		    }
+		    else {
+		        Eigen::GMRES<JacobiDavidsonOperator<MatrixReplacement,Scalar>, Eigen::IdentityPreconditioner> gmres;
+		        gmres.setTolerance(this->linsolve_tol);
+		        gmres.compute(projA);
+		        w = gmres.solve(r);
+		        this->_stats.linsolve.count += gmres.iterations();
+		        this->_stats.apply.count += gmres.iterations() + 1;
+		    }
+		    return w;
+		}
+
+		void _dpr_correction(const PreconditionerT<Scalar> &M, Eigen::Ref<MatrixX> R, const RealVectorX &lambda) const;
+		void _olsen_correction(const PreconditionerT<Scalar> &M, Eigen::Ref<MatrixX> R, const Eigen::Ref<const MatrixX> &BX, const RealVectorX &lambda) const;
+		int _svqb(Eigen::Ref<MatrixX> W, Eigen::Ref<MatrixX> BW) const;
+		void _harmonic_ritz(const DavidsonWorkspace<Scalar> &ws, int nvec, RealVectorX &lambda, MatrixX &U) const;
+		void _sort_by_target(RealVectorX &lambda, MatrixX &U, const RealVectorX &dist) const;
+
+		template<class MatrixReplacementB>
+		int _b_orthonormalize(DavidsonWorkspace<Scalar> &ws, MatrixReplacementB &B, int nvec, int nnew_vec) const
+		{
+		    /* B-orthonormalize the columns nvec:nvec+nnew_vec of V
+
+		    W = W - V (BV^H W)
+
+		    only needs the cached BV, B is applied once to the new block
+		    and BW is then updated along W. Returns the number of columns kept.
+
+		    */
+
+		    auto V = ws.V.leftCols(nvec);
+		    auto BV = ws.BV.leftCols(nvec);
+		    auto W = ws.V.middleCols(nvec,nnew_vec);
+		    auto BW = ws.BV.middleCols(nvec,nnew_vec);
+
+		    MatrixX C = BV.adjoint() * W;
+		    W.noalias() -= V * C;
+		    OperatorProduct<MatrixReplacementB,Scalar>::apply(B,W,BW);
+		    int nkept = DavidsonSolverT::_svqb(W,BW);
+
+		    // second pass to recover the B-orthogonality lost by cancellation
+		    C.noalias() = BV.adjoint() * W.leftCols(nkept);
+		    W.leftCols(nkept).noalias() -= V * C;
+		    BW.leftCols(nkept).noalias() -= BV * C;
+		    nkept = DavidsonSolverT::_svqb(W.leftCols(nkept),BW.leftCols(nkept));
+
+		    // all the corrections are in the search space already
+		    if (nkept == 0 and nnew_vec > 0) {
+		        std::cerr << "B-orthonormalization : all corrections dependent, adding a random vector" << std::endl;
+		        W.col(0).setRandom();
+		        return DavidsonSolverT::_b_orthonormalize<MatrixReplacementB>(ws,B,nvec,1);
+		    }
+		    return nkept;
+		}
 
 		template<class MatrixReplacement>
-		void _update_projected_matrix(Eigen::MatrixXd &T, MatrixReplacement &A, Eigen::MatrixXd &V) const
+		void _update_projected_matrix(DavidsonWorkspace<Scalar> &ws, MatrixReplacement &A, int nvec, int nnew_vec, bool harmonic) const
 		{
-		    int nvec_old = T.cols();
-		    int nvec = V.cols();
-		    int nnew_vec = nvec-nvec_old;
+		    int ntot = nvec+nnew_vec;
 
-		    Eigen::MatrixXd _tmp = A * V.block(0,nvec_old,nvec,nnew_vec);
-		    T.conservativeResize(nvec,nvec);
-		    T.block(0,nvec_old,nvec,nnew_vec) = V.transpose() * _tmp;
-		    T.block(nvec_old,0,nnew_vec,nvec_old) = T.block(0,nvec_old,nvec_old,nnew_vec).transpose();
+		    // only the new vectors are multiplied by A
+		    {
+		        DavidsonTimer timer(this->_stats.apply,nnew_vec);
+		        OperatorProduct<MatrixReplacement,Scalar>::apply(A,ws.V.middleCols(nvec,nnew_vec),ws.AV.middleCols(nvec,nnew_vec));
+		    }
+		    ws.T.block(0,nvec,ntot,nnew_vec).noalias() = ws.V.leftCols(ntot).adjoint() * ws.AV.middleCols(nvec,nnew_vec);
+		    ws.T.block(nvec,0,nnew_vec,nvec) = ws.T.block(0,nvec,nvec,nnew_vec).adjoint();
+
+		    // same update for (AV)^H AV
+		    if (harmonic) {
+		        ws.AVtAV.block(0,nvec,ntot,nnew_vec).noalias() = ws.AV.leftCols(ntot).adjoint() * ws.AV.middleCols(nvec,nnew_vec);
+		        ws.AVtAV.block(nvec,0,nnew_vec,nvec) = ws.AVtAV.block(0,nvec,nvec,nnew_vec).adjoint();
+		    }
 
 		    return;
 		}
 };
 
+template<typename Scalar>
+template<typename Other>
+void DavidsonSolverT<Scalar>::_copy_settings(const DavidsonSolverT<Other> &other)
+{
+    this->iter_max = other.iter_max;
+    this->tol = other.tol;
+    this->max_search_space = other.max_search_space;
+    this->restart_size = other.restart_size;
+    this->restart_previous = other.restart_previous;
+    this->size_initial_guess = other.size_initial_guess;
+    this->linsolve_tol = other.linsolve_tol;
+    this->num_threads = other.num_threads;
+    this->mixed_precision = other.mixed_precision;
+    this->mixed_precision_tol = other.mixed_precision_tol;
+    this->target = other.target;
+    this->sigma = other.sigma;
+    this->target_shift_tol = other.target_shift_tol;
+    this->guess_vectors = other.guess_vectors;
+    this->initial_guess = other.initial_guess.template cast<Scalar>();
+    this->return_unconverged = other.return_unconverged;
+    this->out_of_core_directory = other.out_of_core_directory;
+    this->log_sink = other.log_sink;
+    this->cancellation = other.cancellation;
+    this->has_cancellation = other.has_cancellation;
+    this->correction = static_cast<CORR>(other.correction);
+    this->jacobi_linsolve = static_cast<LSOLVE>(other.jacobi_linsolve);
+    this->orthogonalization = static_cast<ORTHO>(other.orthogonalization);
+    this->preconditioning = static_cast<PRECOND>(other.preconditioning);
+    this->precond_clamp = other.precond_clamp;
+}
+
+typedef DavidsonSolverT<double> DavidsonSolver;
+
 
 #endif
\ No newline at end of file
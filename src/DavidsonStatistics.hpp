@@ -0,0 +1,95 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#ifndef _DAVIDSON_STATISTICS_
+#define _DAVIDSON_STATISTICS_
+
+// destination of the messages of the solver, the solver is silent without one
+typedef std::function<void(const std::string &)> DavidsonLogSink;
+
+// calls, counted items and cumulative wall time of a phase of the solver
+struct DavidsonPhase
+{
+	long calls = 0;
+	long count = 0;
+	double time = 0;
+};
+
+// state of the solver at the end of an iteration
+struct DavidsonIteration
+{
+	int iteration;
+	int search_space;
+	int converged;
+	double residue_norm;
+	double eigenvalue_change;
+	double time;
+};
+
+// instrumentation of the last solve
+//
+//		apply				products of the operator (count : vectors)
+//		subspace			diagonalization of the projected matrix
+//		correction			correction vectors (count : vectors)
+//		orthogonalization	orthogonalization of the corrections and restarts
+//		linsolve			linear systems of the Jacobi-Davidson correction
+//							(count : inner iterations, their products are
+//							counted in apply but timed here)
+struct DavidsonStatistics
+{
+	DavidsonPhase apply;
+	DavidsonPhase subspace;
+	DavidsonPhase correction;
+	DavidsonPhase orthogonalization;
+	DavidsonPhase linsolve;
+	std::vector<DavidsonIteration> history;
+
+	void clear() {*this = DavidsonStatistics();}
+
+	// phases of another solve (the single precision one of the mixed precision mode)
+	void add_phases(const DavidsonStatistics &other)
+	{
+		DavidsonPhase DavidsonStatistics::*phases[] = {&DavidsonStatistics::apply, &DavidsonStatistics::subspace,
+			&DavidsonStatistics::correction, &DavidsonStatistics::orthogonalization, &DavidsonStatistics::linsolve};
+		for (auto phase : phases) {
+			(this->*phase).calls += (other.*phase).calls;
+			(this->*phase).count += (other.*phase).count;
+			(this->*phase).time += (other.*phase).time;
+		}
+	}
+};
+
+// adds the wall time of its scope and count items to a phase
+class DavidsonTimer
+{
+	public:
+
+		DavidsonTimer(DavidsonPhase &phase, long count = 0)
+			: _phase(phase), _start(std::chrono::steady_clock::now())
+		{
+			_phase.calls++;
+			_phase.count += count;
+		}
+
+		~DavidsonTimer() {this->stop();}
+
+		// the time is only added once
+		void stop()
+		{
+			if (_stopped) return;
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+			_phase.time += elapsed.count();
+			_stopped = true;
+		}
+
+	private:
+
+		DavidsonPhase &_phase;
+		std::chrono::steady_clock::time_point _start;
+		bool _stopped = false;
+};
+
+#endif
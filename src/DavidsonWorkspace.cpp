@@ -0,0 +1,281 @@
+#include <iostream>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "DavidsonWorkspace.hpp"
+
+template<typename Scalar>
+DavidsonWorkspace<Scalar>::DavidsonWorkspace(){}
+
+template<typename Scalar>
+DavidsonWorkspace<Scalar>::~DavidsonWorkspace()
+{
+    this->_release_basis();
+}
+
+template<typename Scalar>
+DavidsonWorkspace<Scalar>::DavidsonWorkspace(const DavidsonWorkspace &other)
+{
+    this->_directory = other._directory;
+}
+
+template<typename Scalar>
+DavidsonWorkspace<Scalar>& DavidsonWorkspace<Scalar>::operator=(const DavidsonWorkspace &other)
+{
+    if (this != &other) {
+        this->_release_basis();
+        this->_size = 0;
+        this->_capacity = 0;
+        this->_directory = other._directory;
+    }
+    return *this;
+}
+
+template<typename Scalar>
+void DavidsonWorkspace<Scalar>::set_out_of_core(const std::string &directory)
+{
+    if (directory != this->_directory) {
+        this->_release_basis();
+        this->_directory = directory;
+    }
+}
+
+template<typename Scalar>
+void DavidsonWorkspace<Scalar>::_release_basis()
+{
+    if (this->_mapped) munmap(this->_mapped,this->_mapped_bytes);
+    this->_mapped = nullptr;
+    this->_mapped_bytes = 0;
+    this->_basis.resize(0,0);
+    this->_basis_elements = 0;
+    this->_basis_rows = 0;
+    this->_basis_cols = 0;
+    this->_nbasis = 0;
+    new (&this->V) Eigen::Map<MatrixX>(nullptr,0,0);
+    new (&this->AV) Eigen::Map<MatrixX>(nullptr,0,0);
+    new (&this->BV) Eigen::Map<MatrixX>(nullptr,0,0);
+}
+
+template<typename Scalar>
+void DavidsonWorkspace<Scalar>::_allocate_basis(int rows, int cols, int nbasis)
+{
+    this->_release_basis();
+    std::size_t count = static_cast<std::size_t>(rows) * cols * nbasis;
+    Scalar *data = nullptr;
+
+    if (this->out_of_core()) {
+
+        // the file is unlinked right away : it only lives as long as the mapping
+        std::string name = this->_directory + "/davidson_basis_XXXXXX";
+        std::vector<char> path(name.begin(),name.end());
+        path.push_back('\0');
+        int fd = mkstemp(path.data());
+        if (fd < 0) throw std::runtime_error("Can't create the out of core search space in " + this->_directory);
+        unlink(path.data());
+
+        std::size_t bytes = count * sizeof(Scalar);
+        void *ptr = MAP_FAILED;
+        if (ftruncate(fd,bytes) == 0)
+            ptr = mmap(nullptr,bytes,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+        close(fd);
+        if (ptr == MAP_FAILED) throw std::runtime_error("Can't map the out of core search space in " + this->_directory);
+
+        this->_mapped = static_cast<Scalar*>(ptr);
+        this->_mapped_bytes = bytes;
+        data = this->_mapped;
+    }
+
+    else {
+        this->_basis.resize(rows,static_cast<Eigen::Index>(cols)*nbasis);
+        data = this->_basis.data();
+    }
+
+    this->_basis_elements = count;
+    this->_map_basis(data,rows,cols,nbasis);
+}
+
+template<typename Scalar>
+void DavidsonWorkspace<Scalar>::_map_basis(Scalar *data, int rows, int cols, int nbasis)
+{
+    this->_basis_rows = rows;
+    this->_basis_cols = cols;
+    this->_nbasis = nbasis;
+    std::size_t block = static_cast<std::size_t>(rows) * cols;
+    new (&this->V) Eigen::Map<MatrixX>(data,rows,cols);
+    new (&this->AV) Eigen::Map<MatrixX>(data+block,rows,cols);
+    if (nbasis > 2) new (&this->BV) Eigen::Map<MatrixX>(data+2*block,rows,cols);
+    else new (&this->BV) Eigen::Map<MatrixX>(nullptr,0,0);
+}
+
+template<typename Scalar>
+void DavidsonWorkspace<Scalar>::allocate(int size, int capacity, int nritz, bool generalized, bool harmonic)
+{
+    this->_size = size;
+    this->_capacity = capacity;
+
+    // the buffers are only reallocated when they are too small, a smaller
+    // problem (e.g. the next one of a batch) reuses the same memory
+    int nbasis = generalized ? 3 : 2;
+    if (this->_basis_rows != size or this->_basis_cols < capacity or this->_nbasis < nbasis) {
+        std::size_t count = static_cast<std::size_t>(size) * capacity * nbasis;
+        Scalar *data = this->_mapped ? this->_mapped : this->_basis.data();
+        if (count > 0 and count <= this->_basis_elements) this->_map_basis(data,size,capacity,nbasis);
+        else this->_allocate_basis(size,capacity,nbasis);
+    }
+
+    if (T.cols() < capacity) {
+        T.resize(capacity,capacity);
+    }
+
+    if (ritz.rows() != size or ritz.cols() < nritz) {
+        ritz.resize(size,nritz);
+        Aritz.resize(size,nritz);
+        scratch.resize(size,nritz);
+    }
+
+    if (generalized and (Britz.rows() != size or Britz.cols() < nritz)) {
+        Britz.resize(size,nritz);
+    }
+
+    if (harmonic and AVtAV.cols() < capacity) {
+        AVtAV.resize(capacity,capacity);
+    }
+}
+
+// checkpoint header : dimensions and scalar type of the buffers
+struct CheckpointHeader
+{
+    char magic[8];
+    std::int32_t scalar_size;
+    std::int32_t is_complex;
+    std::int32_t size;
+    std::int32_t neigen;
+    std::int32_t iteration;
+    std::int32_t nvec;
+    std::int32_t search_space;
+    std::int32_t generalized;
+    std::int32_t harmonic;
+    std::int32_t uprev_rows;
+    std::int32_t uprev_cols;
+};
+
+static const char checkpoint_magic[8] = {'D','A','V','I','D','C','K','1'};
+
+// the columns of a block of a column major matrix are contiguous
+template<typename Derived>
+static void write_block(std::ofstream &out, const Eigen::DenseBase<Derived> &M)
+{
+    typedef typename Derived::Scalar Scalar;
+    for (Eigen::Index j=0; j<M.cols(); j++) {
+        out.write(reinterpret_cast<const char*>(M.derived().data()+j*M.derived().outerStride()),M.rows()*sizeof(Scalar));
+    }
+}
+
+template<typename Derived>
+static void read_block(std::ifstream &in, Eigen::DenseBase<Derived> &M)
+{
+    typedef typename Derived::Scalar Scalar;
+    for (Eigen::Index j=0; j<M.cols(); j++) {
+        in.read(reinterpret_cast<char*>(M.derived().data()+j*M.derived().outerStride()),M.rows()*sizeof(Scalar));
+    }
+}
+
+template<typename Scalar>
+void DavidsonWorkspace<Scalar>::write_checkpoint(const std::string &filename, const State &state) const
+{
+    CheckpointHeader header;
+    std::memcpy(header.magic,checkpoint_magic,sizeof(header.magic));
+    header.scalar_size = sizeof(Scalar);
+    header.is_complex = Eigen::NumTraits<Scalar>::IsComplex;
+    header.size = this->_size;
+    header.neigen = state.root_converged.size();
+    header.iteration = state.iteration;
+    header.nvec = state.nvec;
+    header.search_space = state.search_space;
+    header.generalized = state.generalized;
+    header.harmonic = state.harmonic;
+    header.uprev_rows = state.U_prev.rows();
+    header.uprev_cols = state.U_prev.cols();
+
+    std::string tmpname = filename + ".tmp";
+    std::ofstream out(tmpname,std::ios::binary);
+    if (!out) throw std::runtime_error("Can't write the checkpoint file " + tmpname);
+
+    int n = state.nvec;
+    out.write(reinterpret_cast<const char*>(&header),sizeof(header));
+    Eigen::VectorXd converged = state.root_converged.matrix();
+    write_block(out,converged);
+    write_block(out,state.old_val);
+    write_block(out,this->V.leftCols(n));
+    write_block(out,this->AV.leftCols(n));
+    write_block(out,this->T.topLeftCorner(n,n));
+    if (state.generalized) write_block(out,this->BV.leftCols(n));
+    if (state.harmonic) write_block(out,this->AVtAV.topLeftCorner(n,n));
+    write_block(out,state.U_prev);
+    out.close();
+
+    if (!out or std::rename(tmpname.c_str(),filename.c_str()) != 0)
+        throw std::runtime_error("Can't write the checkpoint file " + filename);
+}
+
+template<typename Scalar>
+void DavidsonWorkspace<Scalar>::read_checkpoint(const std::string &filename, State &state)
+{
+    std::ifstream in(filename,std::ios::binary);
+    if (!in) throw std::runtime_error("Can't read the checkpoint file " + filename);
+
+    CheckpointHeader header;
+    in.read(reinterpret_cast<char*>(&header),sizeof(header));
+    bool valid = in and std::memcmp(header.magic,checkpoint_magic,sizeof(header.magic)) == 0
+        and header.scalar_size == sizeof(Scalar)
+        and header.is_complex == Eigen::NumTraits<Scalar>::IsComplex
+        and header.size == this->_size
+        and header.nvec <= this->_capacity
+        and header.neigen == state.root_converged.size()
+        and static_cast<bool>(header.generalized) == state.generalized
+        and static_cast<bool>(header.harmonic) == state.harmonic;
+    if (!valid) throw std::runtime_error("Not a valid checkpoint file");
+
+    state.iteration = header.iteration;
+    state.nvec = header.nvec;
+    state.search_space = header.search_space;
+    state.old_val.resize(header.neigen);
+    state.U_prev.resize(header.uprev_rows,header.uprev_cols);
+
+    int n = state.nvec;
+    Eigen::VectorXd converged(header.neigen);
+    read_block(in,converged);
+    state.root_converged = converged.array();
+    read_block(in,state.old_val);
+    auto V = this->V.leftCols(n);
+    auto AV = this->AV.leftCols(n);
+    auto T = this->T.topLeftCorner(n,n);
+    read_block(in,V);
+    read_block(in,AV);
+    read_block(in,T);
+    if (state.generalized) {
+        auto BV = this->BV.leftCols(n);
+        read_block(in,BV);
+    }
+    if (state.harmonic) {
+        auto AVtAV = this->AVtAV.topLeftCorner(n,n);
+        read_block(in,AVtAV);
+    }
+    read_block(in,state.U_prev);
+
+    if (!in) throw std::runtime_error("Not a valid checkpoint file");
+}
+
+template class DavidsonWorkspace<float>;
+template class DavidsonWorkspace<double>;
+template class DavidsonWorkspace<std::complex<float>>;
+template class DavidsonWorkspace<std::complex<double>>;
@@ -0,0 +1,109 @@
+#include <iostream>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include <string>
+
+#ifndef _DAVIDSON_WORKSPACE_
+#define _DAVIDSON_WORKSPACE_
+
+// Buffers of the Davidson iterations
+// They are allocated once at the maximum size of the search space and
+// the solver works on views of their leading columns, so that the
+// iterations do not reallocate nor copy the search space.
+// Scalar is the scalar type of the search space (real or complex, single or double precision).
+//
+// V, AV and BV map a single block of memory that is either owned by the
+// workspace or, out of core, a file mapped in memory : only the pages
+// touched by the products are resident and the kernel writes them back
+// to the file when memory is short.
+template<typename Scalar>
+class DavidsonWorkspace
+{
+	public:
+
+		typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+		typedef typename Eigen::NumTraits<Scalar>::Real RealScalar;
+		typedef Eigen::Matrix<RealScalar,Eigen::Dynamic,1> RealVectorX;
+
+		// state of the iterations stored along the buffers in checkpoints
+		struct State
+		{
+			int iteration = 0;
+			int nvec = 0;
+			int search_space = 0;
+			bool generalized = false;
+			bool harmonic = false;
+			Eigen::ArrayXd root_converged;
+			RealVectorX old_val;
+			MatrixX U_prev;
+		};
+
+		DavidsonWorkspace();
+		~DavidsonWorkspace();
+
+		// a copy doesn't share the buffers, they are allocated by the next solve
+		DavidsonWorkspace(const DavidsonWorkspace &other);
+		DavidsonWorkspace& operator=(const DavidsonWorkspace &other);
+
+		// out of core search space : V, AV and BV are stored in a temporary
+		// file of directory (removed when the workspace is released)
+		// an empty directory keeps them in memory
+		void set_out_of_core(const std::string &directory);
+		bool out_of_core() const {return !this->_directory.empty();}
+
+		// allocate the buffers for a problem of dimension size
+		// the existing buffers are reused if they are large enough
+		// BV and Britz are only allocated for generalized problems
+		// and AVtAV for the harmonic Ritz extraction
+		void allocate(int size, int capacity, int nritz, bool generalized = false, bool harmonic = false);
+
+		int size() const {return this->_size;}
+		int capacity() const {return this->_capacity;}
+
+		// binary checkpoint of the leading state.nvec columns of V, AV, BV,
+		// of T and AVtAV, and of the state of the iterations
+		// the file is written to filename.tmp and then renamed so that an
+		// interruption during the write keeps the previous checkpoint
+		void write_checkpoint(const std::string &filename, const State &state) const;
+
+		// read a checkpoint in the allocated buffers, the dimensions must match
+		void read_checkpoint(const std::string &filename, State &state);
+
+		// search space, its product with the operator and the projected matrix
+		Eigen::Map<MatrixX> V{nullptr,0,0};
+		Eigen::Map<MatrixX> AV{nullptr,0,0};
+		MatrixX T;
+
+		// Ritz vectors, their product with the operator and a scratch block
+		MatrixX ritz;
+		MatrixX Aritz;
+		MatrixX scratch;
+
+		// product of the search space and of the Ritz vectors with B
+		Eigen::Map<MatrixX> BV{nullptr,0,0};
+		MatrixX Britz;
+
+		// (AV)^H AV, projected matrix of the harmonic Ritz extraction
+		MatrixX AVtAV;
+
+	private:
+
+		int _size = 0;
+		int _capacity = 0;
+
+		// block holding V, AV and BV : nbasis matrices of rows x cols
+		std::string _directory;
+		MatrixX _basis;
+		Scalar *_mapped = nullptr;
+		std::size_t _mapped_bytes = 0;
+		std::size_t _basis_elements = 0;
+		int _basis_rows = 0;
+		int _basis_cols = 0;
+		int _nbasis = 0;
+
+		void _allocate_basis(int rows, int cols, int nbasis);
+		void _map_basis(Scalar *data, int rows, int cols, int nbasis);
+		void _release_basis();
+};
+
+#endif
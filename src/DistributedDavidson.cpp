@@ -0,0 +1,260 @@
+#include <iostream>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <chrono>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include <Eigen/Eigenvalues>
+
+#include "DistributedDavidson.hpp"
+
+#ifdef USE_MPI
+
+void DistributedDavidsonSolver::set_verbose(bool flag) {
+    if (flag) this->log_sink = [](const std::string &message) {std::cout << message << std::flush;};
+    else this->log_sink = nullptr;
+}
+
+// printf-like message sent to the log sink of rank 0
+void DistributedDavidsonSolver::_log(MPI_Comm comm, const char *format, ...) const
+{
+    int rank;
+    MPI_Comm_rank(comm,&rank);
+    if (!this->log_sink or rank != 0) return;
+    char buffer[512];
+    va_list args;
+    va_start(args,format);
+    vsnprintf(buffer,sizeof(buffer),format,args);
+    va_end(args);
+    this->log_sink(buffer);
+}
+
+Eigen::MatrixXd DistributedDavidsonSolver::_allreduce(const Eigen::MatrixXd &local, MPI_Comm comm) const
+{
+    Eigen::MatrixXd global(local.rows(),local.cols());
+    MPI_Allreduce(local.data(),global.data(),local.size(),MPI_DOUBLE,MPI_SUM,comm);
+    return global;
+}
+
+int DistributedDavidsonSolver::_svqb(Eigen::Ref<Eigen::MatrixXd> W, MPI_Comm comm) const
+{
+    /* orthonormalize W in place from the eigendecomposition of its Gram matrix
+
+    S = D^{-1/2} W^T W D^{-1/2} = Q \Lambda Q^T      W = W D^{-1/2} Q \Lambda^{-1/2}
+
+    where D = diag(W^T W) and W^T W is reduced over the ranks.
+    The directions with small eigenvalues are dropped.
+
+    */
+
+    int n = W.cols();
+    if (n == 0) return 0;
+    Eigen::MatrixXd S = DistributedDavidsonSolver::_allreduce(W.transpose() * W,comm);
+    Eigen::VectorXd d = S.diagonal().cwiseMax(0.0).cwiseSqrt();
+    for (int i=0; i<n; i++) {
+        if (d(i) == 0) d(i) = 1;
+    }
+    S = d.cwiseInverse().asDiagonal() * S * d.cwiseInverse().asDiagonal();
+
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(S);
+    double max_eig = es.eigenvalues().cwiseAbs().maxCoeff();
+    int nkept = 0;
+    Eigen::MatrixXd X(n,n);
+    for (int i=n-1; i>=0; i--) {
+        double e = es.eigenvalues()(i);
+        if (e <= this->orth_tol * max_eig) break;
+        X.col(nkept) = d.cwiseInverse().asDiagonal() * es.eigenvectors().col(i) / std::sqrt(e);
+        nkept++;
+    }
+
+    Eigen::MatrixXd tmp = W * X.leftCols(nkept);
+    W.leftCols(nkept) = tmp;
+    return nkept;
+}
+
+int DistributedDavidsonSolver::_orthogonalize(const Eigen::Ref<const Eigen::MatrixXd> &V, Eigen::Ref<Eigen::MatrixXd> W, MPI_Comm comm) const
+{
+    // two passes of block classical Gram-Schmidt against V followed by SVQB,
+    // one reduction of V^T W and one of W^T W per pass
+    int nkept = W.cols();
+    for (int pass=0; pass<2 and nkept>0; pass++) {
+        auto Wk = W.leftCols(nkept);
+        Eigen::MatrixXd P = DistributedDavidsonSolver::_allreduce(V.transpose() * Wk,comm);
+        Wk.noalias() -= V * P;
+        nkept = DistributedDavidsonSolver::_svqb(Wk,comm);
+    }
+    return nkept;
+}
+
+void DistributedDavidsonSolver::solve(const DistributedOperator &A, int neigen, int size_initial_guess)
+{
+    MPI_Comm comm = A.comm();
+
+    DistributedDavidsonSolver::_log(comm,"\n===========================\n");
+    DistributedDavidsonSolver::_log(comm,"= Davidson (DPR)\n");
+    int nranks;
+    MPI_Comm_size(comm,&nranks);
+    DistributedDavidsonSolver::_log(comm,"= distributed : %d ranks\n",nranks);
+    DistributedDavidsonSolver::_log(comm,"===========================\n\n");
+
+    this->_iterations = 0;
+    this->_stats.clear();
+    std::chrono::steady_clock::time_point solve_start = std::chrono::steady_clock::now();
+
+    int size = A.rows();
+    int nlocal = A.local_rows();
+
+    // same search space sizes as the shared memory solver
+    if (size_initial_guess == 0) {
+        size_initial_guess = 2 * neigen;
+        if (size_initial_guess < 10)
+            size_initial_guess = 10;
+    }
+    size_initial_guess = std::min(std::max(size_initial_guess,neigen),size);
+    int nkeep = std::max(this->restart_size,neigen);
+    int max_space = this->max_search_space;
+    if (max_space == 0) max_space = 2*size_initial_guess;
+    max_space = std::max(max_space,nkeep+neigen);
+    max_space = std::max(max_space,size_initial_guess);
+    max_space = std::min(max_space,size);
+
+    // local rows of the search space and of its product
+    Eigen::MatrixXd V = Eigen::MatrixXd::Zero(nlocal,max_space+neigen);
+    Eigen::MatrixXd AV = Eigen::MatrixXd::Zero(nlocal,max_space+neigen);
+    Eigen::MatrixXd T = Eigen::MatrixXd::Zero(max_space+neigen,max_space+neigen);
+    Eigen::VectorXd D = A.diagonal();
+
+    // initial guess : unit vectors of the smallest diagonal elements
+    // of the whole operator, set by the rank that owns their row
+    Eigen::VectorXd Dfull = A.gather(D);
+    std::vector<int> index(size);
+    std::iota(index.begin(),index.end(),0);
+    std::stable_sort(index.begin(),index.end(),[&](int i, int j) {return Dfull(i) < Dfull(j);});
+    int offset = A.row_offset();
+    for (int k=0; k<size_initial_guess; k++) {
+        int i = index[k] - offset;
+        if (i >= 0 and i < nlocal) V(i,k) = 1;
+    }
+    int nvec = size_initial_guess;
+    {
+        DavidsonTimer apply_timer(this->_stats.apply,nvec);
+        A.apply(V.leftCols(nvec),AV.leftCols(nvec));
+    }
+    T.topLeftCorner(nvec,nvec) = DistributedDavidsonSolver::_allreduce(V.leftCols(nvec).transpose() * AV.leftCols(nvec),comm);
+
+    Eigen::ArrayXd res_norm = Eigen::ArrayXd::Zero(neigen);
+    Eigen::ArrayXd lambda_conv = Eigen::ArrayXd::Zero(neigen);
+    Eigen::VectorXd old_val = Eigen::VectorXd::Zero(neigen);
+    Eigen::VectorXd lambda;
+    Eigen::MatrixXd U;
+    bool has_converged = false;
+
+    DistributedDavidsonSolver::_log(comm,"iter\tSearch Space\tNorm/%.0e\n",tol);
+    DistributedDavidsonSolver::_log(comm,"-----------------------------------\n");
+
+    for (int iiter = 0; iiter < iter_max; iiter++) {
+
+        this->_iterations = iiter+1;
+
+        // Ritz pairs, the same on every rank
+        {
+            DavidsonTimer subspace_timer(this->_stats.subspace);
+            Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(T.topLeftCorner(nvec,nvec));
+            lambda = es.eigenvalues();
+            U = es.eigenvectors();
+        }
+
+        // residues of the local rows and their global norms
+        DavidsonTimer correction_timer(this->_stats.correction);
+        Eigen::MatrixXd R = AV.leftCols(nvec) * U.leftCols(neigen) - V.leftCols(nvec) * U.leftCols(neigen) * lambda.head(neigen).asDiagonal();
+        Eigen::MatrixXd norms = DistributedDavidsonSolver::_allreduce(R.colwise().squaredNorm(),comm);
+        res_norm = norms.row(0).transpose().array().sqrt();
+        lambda_conv = (lambda.head(neigen)-old_val).array().abs();
+        old_val = lambda.head(neigen);
+
+        // DPR corrections of the roots not converged, with clamped denominators
+        int nnew = 0;
+        for (int j=0; j<neigen; j++) {
+            if (res_norm(j) < tol) continue;
+            for (int i=0; i<nlocal; i++) {
+                double d = D(i) - lambda(j);
+                if (std::abs(d) < this->precond_clamp) d = (d < 0) ? -this->precond_clamp : this->precond_clamp;
+                R(i,nnew) = -R(i,j) / d;
+            }
+            nnew++;
+        }
+        this->_stats.correction.count += nnew;
+        correction_timer.stop();
+
+        DistributedDavidsonSolver::_log(comm,"%4d\t%12d\t%4.2e\t%4.2e\t%4.1f%% converged\n", iiter,nvec,res_norm.maxCoeff(),lambda_conv.maxCoeff(),100.0*(neigen-nnew)/neigen);
+
+        DavidsonIteration record;
+        record.iteration = iiter;
+        record.search_space = nvec;
+        record.converged = neigen-nnew;
+        record.residue_norm = res_norm.maxCoeff();
+        record.eigenvalue_change = lambda_conv.maxCoeff();
+        record.time = std::chrono::duration<double>(std::chrono::steady_clock::now()-solve_start).count();
+        this->_stats.history.push_back(record);
+
+        if (nnew == 0) {
+            has_converged = true;
+            break;
+        }
+
+        DavidsonTimer orthogonalization_timer(this->_stats.orthogonalization);
+
+        // thick restart on the nkeep lowest Ritz vectors
+        if (nvec + nnew > max_space) {
+            int nrestart = std::min(nkeep,nvec);
+            Eigen::MatrixXd tmp = V.leftCols(nvec) * U.leftCols(nrestart);
+            V.leftCols(nrestart) = tmp;
+            tmp = AV.leftCols(nvec) * U.leftCols(nrestart);
+            AV.leftCols(nrestart) = tmp;
+            T.topLeftCorner(nrestart,nrestart) = lambda.head(nrestart).asDiagonal();
+            nvec = nrestart;
+        }
+
+        auto W = V.middleCols(nvec,nnew);
+        W = R.leftCols(nnew);
+        nnew = DistributedDavidsonSolver::_orthogonalize(V.leftCols(nvec),W,comm);
+        orthogonalization_timer.stop();
+        if (nnew == 0) {
+            DistributedDavidsonSolver::_log(comm,"- no new direction in the search space\n");
+            break;
+        }
+
+        // new columns and rows of the projected matrix
+        {
+            DavidsonTimer apply_timer(this->_stats.apply,nnew);
+            A.apply(V.middleCols(nvec,nnew),AV.middleCols(nvec,nnew));
+        }
+        Eigen::MatrixXd Tnew = DistributedDavidsonSolver::_allreduce(V.leftCols(nvec+nnew).transpose() * AV.middleCols(nvec,nnew),comm);
+        T.block(0,nvec,nvec+nnew,nnew) = Tnew;
+        T.block(nvec,0,nnew,nvec) = Tnew.topRows(nvec).transpose();
+        nvec += nnew;
+    }
+
+    // local rows of the Ritz vectors
+    this->_eigenvalues = lambda.head(neigen);
+    this->_eigenvectors = V.leftCols(nvec) * U.leftCols(neigen);
+    this->_converged = has_converged;
+
+    DistributedDavidsonSolver::_log(comm,"-----------------------------------\n");
+    if (!has_converged) {
+        DistributedDavidsonSolver::_log(comm,"- Warning : Davidson didn't converge ! \n");
+        this->_eigenvalues = Eigen::VectorXd::Zero(neigen);
+        this->_eigenvectors = Eigen::MatrixXd::Zero(nlocal,neigen);
+    }
+    else {
+        DistributedDavidsonSolver::_log(comm,"- Davidson converged \n");
+        DistributedDavidsonSolver::_log(comm,"- final residue norm %4.2e\n",res_norm.maxCoeff());
+        DistributedDavidsonSolver::_log(comm,"- final eigenvalue norm %4.2e\n",lambda_conv.maxCoeff());
+    }
+    DistributedDavidsonSolver::_log(comm,"-----------------------------------\n");
+}
+
+#endif
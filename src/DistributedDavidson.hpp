@@ -0,0 +1,78 @@
+#include <iostream>
+#include <string>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+
+#include "DistributedOperator.hpp"
+#include "DavidsonStatistics.hpp"
+
+#ifndef _DISTRIBUTED_DAVIDSON_
+#define _DISTRIBUTED_DAVIDSON_
+
+#ifdef USE_MPI
+#include <mpi.h>
+
+// Davidson solver (DPR correction) of the distributed-memory mode
+//
+// the basis V and its product AV are row-partitioned like the operator,
+// the projected matrix T = V^T AV and the Gram matrices of the
+// orthogonalization are reduced over the ranks with MPI_Allreduce and the
+// small eigenproblems are solved redundantly on every rank
+// all the ranks of the communicator of the operator call solve()
+class DistributedDavidsonSolver
+{
+	public:
+
+		DistributedDavidsonSolver() {}
+
+		void set_iter_max(int N) { this->iter_max = N; }
+		void set_tolerance(double eps) { this->tol = eps; }
+		void set_max_search_space(int N) { this->max_search_space = N;}
+		void set_restart_size(int N) { this->restart_size = N;}
+
+		// messages of the solver, only written by rank 0
+		void set_log_sink(DavidsonLogSink sink) {this->log_sink = sink;}
+		void set_verbose(bool flag);
+
+		void solve(const DistributedOperator &A, int neigen, int size_initial_guess = 0);
+
+		// the eigenvalues are the same on every rank, the eigenvectors are
+		// the local rows of the operator
+		Eigen::VectorXd eigenvalues() const {return this->_eigenvalues;}
+		Eigen::MatrixXd eigenvectors() const {return this->_eigenvectors;}
+
+		const DavidsonStatistics& statistics() const {return this->_stats;}
+		int iterations() const {return this->_iterations;}
+		bool converged() const {return this->_converged;}
+		long matvecs() const {return this->_stats.apply.count;}
+
+	private :
+
+		int iter_max = 1000;
+		double tol = 1E-6;
+		int max_search_space = 0;
+		int restart_size = 0;
+		double precond_clamp = 1E-3;
+		double orth_tol = 1E-10;
+		DavidsonLogSink log_sink;
+
+		Eigen::VectorXd _eigenvalues;
+		Eigen::MatrixXd _eigenvectors;
+		int _iterations = 0;
+		bool _converged = false;
+		DavidsonStatistics _stats;
+
+		void _log(MPI_Comm comm, const char *format, ...) const;
+
+		// sum of a small matrix over the ranks
+		Eigen::MatrixXd _allreduce(const Eigen::MatrixXd &local, MPI_Comm comm) const;
+
+		// orthonormalize W against the nvec first columns of V and
+		// in itself, returns the number of columns kept
+		int _orthogonalize(const Eigen::Ref<const Eigen::MatrixXd> &V, Eigen::Ref<Eigen::MatrixXd> W, MPI_Comm comm) const;
+		int _svqb(Eigen::Ref<Eigen::MatrixXd> W, MPI_Comm comm) const;
+};
+
+#endif
+
+#endif
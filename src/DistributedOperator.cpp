@@ -0,0 +1,116 @@
+#include <iostream>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+#include "DistributedOperator.hpp"
+
+#ifdef USE_MPI
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// constructors
+DistributedOperator::DistributedOperator(const MatrixFreeOperator &A, double drop_tol, MPI_Comm comm)
+{
+    DistributedOperator::_partition(A.rows(),comm);
+    int nrows = this->local_rows();
+    int offset = this->row_offset();
+
+    // row i of the symmetric operator is its column i
+    // each thread keeps its own list of elements
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    std::vector<std::vector<Eigen::Triplet<double>>> elements(nthreads);
+
+    #pragma omp parallel
+    {
+        int tid = 0;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+#endif
+        #pragma omp for schedule(static)
+        for (int i=0; i<nrows; i++) {
+            Eigen::VectorXd row_data = A.col(offset+i);
+            for (int j=0; j<_size; j++) {
+                if (j==offset+i or std::abs(row_data(j)) > drop_tol)
+                    elements[tid].push_back(Eigen::Triplet<double>(i,j,row_data(j)));
+            }
+        }
+    }
+
+    // merge the lists in thread order
+    std::vector<Eigen::Triplet<double>> triplets;
+    for (auto &list : elements)
+        triplets.insert(triplets.end(),list.begin(),list.end());
+
+    _matrix.resize(nrows,_size);
+    _matrix.setFromTriplets(triplets.begin(),triplets.end());
+    _matrix.makeCompressed();
+}
+
+DistributedOperator::DistributedOperator(const SparseMatrix &S, MPI_Comm comm)
+{
+    DistributedOperator::_partition(S.rows(),comm);
+    _matrix = S.middleRows(this->row_offset(),this->local_rows());
+    _matrix.makeCompressed();
+}
+
+void DistributedOperator::_partition(int size, MPI_Comm comm)
+{
+    int nranks;
+    MPI_Comm_rank(comm,&_rank);
+    MPI_Comm_size(comm,&nranks);
+    _comm = comm;
+    _size = size;
+
+    // the first size % nranks ranks have one more row
+    _counts.resize(nranks);
+    _offsets.resize(nranks);
+    int offset = 0;
+    for (int p=0; p<nranks; p++) {
+        _counts[p] = size / nranks + (p < size % nranks ? 1 : 0);
+        _offsets[p] = offset;
+        offset += _counts[p];
+    }
+}
+
+Eigen::VectorXd DistributedOperator::diagonal() const
+{
+    int offset = this->row_offset();
+    Eigen::VectorXd diag = Eigen::VectorXd::Zero(this->local_rows());
+    for (int i=0; i<_matrix.outerSize(); i++) {
+        for (SparseMatrix::InnerIterator it(_matrix,i); it; ++it) {
+            if (it.col() == offset+i) diag(i) = it.value();
+        }
+    }
+    return diag;
+}
+
+Eigen::MatrixXd DistributedOperator::gather(const Eigen::Ref<const Eigen::MatrixXd>& X) const
+{
+    // the rows of a rank are contiguous in the transposed block
+    int ncols = X.cols();
+    int nranks = _counts.size();
+    std::vector<int> counts(nranks), offsets(nranks);
+    for (int p=0; p<nranks; p++) {
+        counts[p] = _counts[p] * ncols;
+        offsets[p] = _offsets[p] * ncols;
+    }
+
+    Eigen::MatrixXd Xt = X.transpose();
+    Eigen::MatrixXd Xfull_t(ncols,_size);
+    MPI_Allgatherv(Xt.data(),counts[_rank],MPI_DOUBLE,Xfull_t.data(),counts.data(),offsets.data(),MPI_DOUBLE,_comm);
+    return Xfull_t.transpose();
+}
+
+void DistributedOperator::apply(const Eigen::Ref<const Eigen::MatrixXd>& X, Eigen::Ref<Eigen::MatrixXd> Y) const
+{
+    Eigen::MatrixXd Xfull = DistributedOperator::gather(X);
+    Y.noalias() = _matrix * Xfull;
+}
+
+#endif
@@ -0,0 +1,70 @@
+#include <iostream>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+#include "MatrixFreeOperator.hpp"
+
+#ifndef _DISTRIBUTED_OP_
+#define _DISTRIBUTED_OP_
+
+#ifdef USE_MPI
+#include <mpi.h>
+
+// Row-partitioned operator of the distributed-memory (MPI) solver
+//
+// each rank stores the rows [row_offset(), row_offset()+local_rows()) of
+// the operator as a sparse matrix, the rows are split in contiguous blocks
+// of (almost) equal size in the rank order of the communicator
+// the blocks of vectors passed to apply() hold the same rows
+class DistributedOperator
+{
+	public:
+
+		typedef Eigen::SparseMatrix<double,Eigen::RowMajor> SparseMatrix;
+
+		// local rows of a matrix free operator, the elements below drop_tol
+		// are dropped (the diagonal is always kept), the operator is symmetric
+		// and its rows are generated with col()
+		DistributedOperator(const MatrixFreeOperator &A, double drop_tol, MPI_Comm comm = MPI_COMM_WORLD);
+
+		// local rows of a global sparse matrix available on every rank
+		DistributedOperator(const SparseMatrix &S, MPI_Comm comm = MPI_COMM_WORLD);
+
+		int rows() const {return this->_size;}
+		int cols() const {return this->_size;}
+		int local_rows() const {return this->_counts[this->_rank];}
+		int row_offset() const {return this->_offsets[this->_rank];}
+		MPI_Comm comm() const {return this->_comm;}
+
+		// local diagonal elements
+		Eigen::VectorXd diagonal() const;
+
+		// Y = A * X for the local rows of X and Y
+		// the block X is gathered on every rank before the product
+		void apply(const Eigen::Ref<const Eigen::MatrixXd>& X, Eigen::Ref<Eigen::MatrixXd> Y) const;
+
+		// complete block from the local rows of every rank
+		Eigen::MatrixXd gather(const Eigen::Ref<const Eigen::MatrixXd>& X) const;
+
+		const SparseMatrix& local_matrix() const {return this->_matrix;}
+
+	private:
+
+		MPI_Comm _comm;
+		int _rank;
+		int _size;
+
+		// rows of each rank
+		std::vector<int> _counts;
+		std::vector<int> _offsets;
+
+		// local rows x all the columns
+		SparseMatrix _matrix;
+
+		void _partition(int size, MPI_Comm comm);
+};
+
+#endif
+
+#endif
@@ -0,0 +1,92 @@
+#include <iostream>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+
+#include "MatrixFreeOperator.hpp"
+
+#ifndef _JACOBI_DAVIDSON_OP_
+#define _JACOBI_DAVIDSON_OP_
+
+template<typename MatrixReplacement, typename Scalar> class JacobiDavidsonOperator;
+
+namespace Eigen { namespace internal {
+		template<typename MatrixReplacement, typename Scalar>
+		struct traits<JacobiDavidsonOperator<MatrixReplacement,Scalar>> : public Eigen::internal::traits<Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic>> {};
+	}
+}
+
+// implicit projected operator of the Jacobi-Davidson correction equation
+//
+//		(I - u u^T) (A - lambda I) (I - u u^T)
+//
+// each product costs one product with A and two dot products
+// the products are done in the precision of Scalar, u^T is u^H for complex operators
+template<typename MatrixReplacement, typename Scalar_>
+class JacobiDavidsonOperator : public Eigen::EigenBase<JacobiDavidsonOperator<MatrixReplacement,Scalar_>>
+{
+	public:
+
+		typedef Scalar_ Scalar;
+		typedef typename Eigen::NumTraits<Scalar_>::Real RealScalar;
+		typedef int StorageIndex;
+		typedef Eigen::Index Index;
+		typedef Eigen::Matrix<Scalar,Eigen::Dynamic,1> VectorX;
+
+		enum {
+			ColsAtCompileTime = Eigen::Dynamic,
+			MaxColsAtCompileTime = Eigen::Dynamic,
+			IsRowMajor = false
+		};
+
+		JacobiDavidsonOperator(const MatrixReplacement &A, const VectorX &u, Scalar lambda)
+			: _A(A), _u(u), _lambda(lambda) {}
+
+		Index rows() const {return this->_A.rows();}
+		Index cols() const {return this->_A.cols();}
+
+		template<typename Vtype>
+		Eigen::Product<JacobiDavidsonOperator,Vtype,Eigen::AliasFreeProduct> operator*(const Eigen::MatrixBase<Vtype>& x) const {
+			return Eigen::Product<JacobiDavidsonOperator,Vtype,Eigen::AliasFreeProduct>(*this, x.derived());
+		}
+
+		// returns (I - u u^T) (A - lambda I) (I - u u^T) x
+		VectorX apply(const Eigen::Ref<const VectorX> &x) const
+		{
+			VectorX y = x - this->_u.dot(x) * this->_u;
+			VectorX z(y.size());
+			OperatorProduct<MatrixReplacement,Scalar>::apply(this->_A,y,z);
+			z -= this->_lambda * y;
+			z -= this->_u.dot(z) * this->_u;
+			return z;
+		}
+
+	private:
+
+		const MatrixReplacement &_A;
+		const VectorX &_u;
+		Scalar _lambda;
+};
+
+namespace Eigen{
+
+	namespace internal{
+
+		// replacement of the mat*vect operation
+		template<typename MatrixReplacement, typename S, typename Vtype>
+		struct generic_product_impl<JacobiDavidsonOperator<MatrixReplacement,S>, Vtype, DenseShape, DenseShape, GemvProduct>
+		: generic_product_impl_base<JacobiDavidsonOperator<MatrixReplacement,S>,Vtype,generic_product_impl<JacobiDavidsonOperator<MatrixReplacement,S>,Vtype>>
+		{
+
+			typedef typename Product<JacobiDavidsonOperator<MatrixReplacement,S>,Vtype>::Scalar Scalar;
+
+			template<typename Dest>
+			static void scaleAndAddTo(Dest& dst, const JacobiDavidsonOperator<MatrixReplacement,S>& op, const Vtype &v, const Scalar& alpha)
+			{
+				//returns dst += alpha * op * v
+				dst += alpha * op.apply(v);
+			}
+		};
+	}
+}
+
+#endif
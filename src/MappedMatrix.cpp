@@ -0,0 +1,125 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "MappedMatrix.hpp"
+
+// 64 bytes header, the data that follows is aligned for the vectorized kernels
+struct MappedMatrixHeader
+{
+    char magic[8];
+    std::int64_t rows;
+    std::int64_t cols;
+    std::int32_t dtype;
+    std::int32_t symmetric;
+    char padding[32];
+};
+
+static_assert(sizeof(MappedMatrixHeader) == 64, "the matrix file header must be 64 bytes");
+
+static const char mapped_matrix_magic[8] = {'D','A','V','M','A','T','0','1'};
+
+template<typename Scalar> struct MappedMatrixType;
+template<> struct MappedMatrixType<float> {static const int dtype = 0;};
+template<> struct MappedMatrixType<double> {static const int dtype = 1;};
+template<> struct MappedMatrixType<std::complex<float>> {static const int dtype = 2;};
+template<> struct MappedMatrixType<std::complex<double>> {static const int dtype = 3;};
+
+template<typename Scalar>
+MappedMatrixT<Scalar>::MappedMatrixT(const std::string &filename)
+{
+    int fd = open(filename.c_str(),O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Can't open the matrix file " + filename);
+
+    struct stat st;
+    void *ptr = MAP_FAILED;
+    if (fstat(fd,&st) == 0 and static_cast<std::size_t>(st.st_size) >= sizeof(MappedMatrixHeader))
+        ptr = mmap(nullptr,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (ptr == MAP_FAILED) throw std::runtime_error("Not a valid matrix file " + filename);
+
+    this->_data = ptr;
+    this->_bytes = st.st_size;
+
+    // check the header before exposing the data
+    MappedMatrixHeader header;
+    std::memcpy(&header,ptr,sizeof(header));
+    std::size_t expected = sizeof(header) + static_cast<std::size_t>(header.rows) * header.cols * sizeof(Scalar);
+    bool valid = std::memcmp(header.magic,mapped_matrix_magic,sizeof(header.magic)) == 0
+        and header.dtype == MappedMatrixType<Scalar>::dtype
+        and header.rows >= 0 and header.cols >= 0
+        and this->_bytes == expected;
+    if (!valid) {
+        munmap(this->_data,this->_bytes);
+        throw std::runtime_error("Not a valid matrix file " + filename);
+    }
+
+    this->_symmetric = header.symmetric;
+    const Scalar *data = reinterpret_cast<const Scalar*>(static_cast<const char*>(ptr) + sizeof(header));
+    new (&this->_matrix) ConstMap(data,header.rows,header.cols);
+}
+
+template<typename Scalar>
+MappedMatrixT<Scalar>::~MappedMatrixT()
+{
+    if (this->_data) munmap(this->_data,this->_bytes);
+}
+
+template<typename Scalar>
+void MappedMatrixT<Scalar>::write(const std::string &filename, const MatrixX &A, bool symmetric)
+{
+    MappedMatrixHeader header;
+    std::memset(&header,0,sizeof(header));
+    std::memcpy(header.magic,mapped_matrix_magic,sizeof(header.magic));
+    header.rows = A.rows();
+    header.cols = A.cols();
+    header.dtype = MappedMatrixType<Scalar>::dtype;
+    header.symmetric = symmetric;
+
+    std::ofstream out(filename,std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&header),sizeof(header));
+    out.write(reinterpret_cast<const char*>(A.data()),A.size()*sizeof(Scalar));
+    if (!out) throw std::runtime_error("Can't write the matrix file " + filename);
+}
+
+Eigen::MatrixXd read_text_matrix(const std::string &filename)
+{
+    std::ifstream infile(filename);
+    if (!infile) throw std::runtime_error("Can't open the matrix file " + filename);
+
+    // the elements are read row by row, all rows must have the same length
+    std::vector<double> buff;
+    std::string line;
+    int rows = 0, cols = 0;
+    while (std::getline(infile,line)) {
+        std::stringstream stream(line);
+        double value;
+        int ncols = 0;
+        while (stream >> value) {
+            buff.push_back(value);
+            ncols++;
+        }
+        if (ncols == 0) continue;
+        if (cols == 0) cols = ncols;
+        if (ncols != cols) throw std::runtime_error("Not a valid matrix file " + filename);
+        rows++;
+    }
+
+    return Eigen::Map<Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor>>(buff.data(),rows,cols);
+}
+
+template class MappedMatrixT<float>;
+template class MappedMatrixT<double>;
+template class MappedMatrixT<std::complex<float>>;
+template class MappedMatrixT<std::complex<double>>;
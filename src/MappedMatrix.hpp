@@ -0,0 +1,56 @@
+#include <iostream>
+#include <string>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+
+#ifndef _MAPPED_MATRIX_
+#define _MAPPED_MATRIX_
+
+// Dense matrix stored in a binary file and mapped in memory without copy
+//
+// file layout : a 64 bytes header followed by the column major data
+//
+//		char    magic[8]	"DAVMAT01"
+//		int64   rows, cols
+//		int32   dtype		0 float, 1 double, 2 complex<float>, 3 complex<double>
+//		int32   symmetric	1 if the matrix is symmetric (Hermitian)
+//		padding up to 64 bytes
+//
+// the data is read lazily by the kernel as the solver touches it
+template<typename Scalar>
+class MappedMatrixT
+{
+	public:
+
+		typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+		typedef Eigen::Map<const MatrixX> ConstMap;
+
+		// map the file, throws if it is not a matrix of Scalar
+		explicit MappedMatrixT(const std::string &filename);
+		~MappedMatrixT();
+
+		MappedMatrixT(const MappedMatrixT &) = delete;
+		MappedMatrixT& operator=(const MappedMatrixT &) = delete;
+
+		// read only view of the data, can be given to DavidsonSolver::solve
+		const ConstMap& matrix() const {return this->_matrix;}
+		bool symmetric() const {return this->_symmetric;}
+
+		// write A in the binary format
+		static void write(const std::string &filename, const MatrixX &A, bool symmetric = true);
+
+	private:
+
+		void *_data = nullptr;
+		std::size_t _bytes = 0;
+		bool _symmetric = false;
+		ConstMap _matrix{nullptr,0,0};
+};
+
+typedef MappedMatrixT<double> MappedMatrix;
+
+// text matrix, one row per line of whitespace separated numbers
+// only used to convert text files to the binary format
+Eigen::MatrixXd read_text_matrix(const std::string &filename);
+
+#endif
@@ -3,37 +3,101 @@
 #include <Eigen/Core>
 #include "MatrixFreeOperator.hpp"
 
-MatrixFreeOperator::MatrixFreeOperator(){}
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+template<typename Scalar>
+MatrixFreeOperatorT<Scalar>::MatrixFreeOperatorT(){}
 
 
 // virtual here : get a col of the operator
-Eigen::VectorXd MatrixFreeOperator::col(int index) const
+template<typename Scalar>
+typename MatrixFreeOperatorT<Scalar>::VectorX MatrixFreeOperatorT<Scalar>::col(int index) const
 {
     throw std::runtime_error("MatrixFreeOperator.col() not defined in class");
 }
 
-Eigen::VectorXd MatrixFreeOperator::diagonal() const
+template<typename Scalar>
+Scalar MatrixFreeOperatorT<Scalar>::diagonal_element(int index) const
 {
-    Eigen::VectorXd D = Eigen::VectorXd::Zero(_size,1);
-    Eigen::VectorXd col_data;
+    return this->col(index)(index);
+}
+
+template<typename Scalar>
+typename MatrixFreeOperatorT<Scalar>::VectorX MatrixFreeOperatorT<Scalar>::diagonal() const
+{
+    VectorX D = VectorX::Zero(_size,1);
     for(int i=0; i<_size;i++) {
-        col_data = this->col(i);
-        D(i) = col_data(i);
+        D(i) = this->diagonal_element(i);
     }
     return D;
 }
 
-// get the full matrix if we have to
-Eigen::MatrixXd MatrixFreeOperator::get_full_mat() const
+// apply the operator to a block of vectors : Y = A * X
+// the columns are generated once per call in panels of _panel_size
+// columns per thread so that the product itself is a gemm
+// each column of the panel is written by a single thread and the
+// accumulation order does not depend on the scheduling
+template<typename Scalar>
+void MatrixFreeOperatorT<Scalar>::apply(const Eigen::Ref<const MatrixX>& X, Eigen::Ref<MatrixX> Y) const
 {
-	Eigen::MatrixXd matrix = Eigen::MatrixXd::Zero(_size,_size);
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    int nb = std::min(_panel_size*nthreads,_size);
+    MatrixX panel(_size,nb);
 
-    #pragma openmp parallel for
-    for(int i=0; i<_size; i++){
-        matrix.col(i) = this->col(i);
+    Y.setZero();
+    for (int start=0; start<_size; start+=nb) {
+        int ncols = std::min(nb,_size-start);
+        this->_fill_panel(start,panel.leftCols(ncols));
+        Y.noalias() += panel.leftCols(ncols) * X.middleRows(start,ncols);
+    }
+}
+
+// single precision product : the panels are generated in the precision of the operator
+// and rounded, so that the gemm moves half the data
+template<typename Scalar>
+void MatrixFreeOperatorT<Scalar>::apply_single(const Eigen::Ref<const MatrixXs>& X, Eigen::Ref<MatrixXs> Y) const
+{
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    int nb = std::min(_panel_size*nthreads,_size);
+    MatrixX panel(_size,nb);
+    MatrixXs panel_single(_size,nb);
+
+    Y.setZero();
+    for (int start=0; start<_size; start+=nb) {
+        int ncols = std::min(nb,_size-start);
+        this->_fill_panel(start,panel.leftCols(ncols));
+        panel_single.leftCols(ncols) = panel.leftCols(ncols).template cast<SingleScalar>();
+        Y.noalias() += panel_single.leftCols(ncols) * X.middleRows(start,ncols);
     }
-    return matrix; 
 }
 
+template<typename Scalar>
+void MatrixFreeOperatorT<Scalar>::_fill_panel(int start, Eigen::Ref<MatrixX> panel) const
+{
+    #pragma omp parallel for schedule(static)
+    for (int i=0; i<panel.cols(); i++) {
+        panel.col(i) = this->col(start+i);
+    }
+}
 
+// get the full matrix if we have to
+template<typename Scalar>
+typename MatrixFreeOperatorT<Scalar>::MatrixX MatrixFreeOperatorT<Scalar>::get_full_mat() const
+{
+	MatrixX matrix = MatrixX::Zero(_size,_size);
+    this->_fill_panel(0,matrix);
+    return matrix; 
+}
 
+template class MatrixFreeOperatorT<float>;
+template class MatrixFreeOperatorT<double>;
+template class MatrixFreeOperatorT<std::complex<float>>;
+template class MatrixFreeOperatorT<std::complex<double>>;
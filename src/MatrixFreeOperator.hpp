@@ -1,25 +1,41 @@
 #include <iostream>
+#include <complex>
 #include <Eigen/Dense>
 #include <Eigen/Core>
+#include <type_traits>
 
 #ifndef _MATRIX_FREE_OP_
 #define _MATRIX_FREE_OP_
 
-class MatrixFreeOperator;
+template<typename Scalar> class MatrixFreeOperatorT;
 
 namespace Eigen { namespace internal {
-		template<>
-		struct traits<MatrixFreeOperator> : public Eigen::internal::traits<Eigen::MatrixXd> {};
+		template<typename Scalar>
+		struct traits<MatrixFreeOperatorT<Scalar>> : public Eigen::internal::traits<Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic>> {};
 	}
 }
 
-class MatrixFreeOperator : public Eigen::EigenBase<Eigen::MatrixXd>
+// scalar type of the single precision products
+template<typename Scalar> struct SinglePrecision {typedef float type;};
+template<typename Real> struct SinglePrecision<std::complex<Real>> {typedef std::complex<float> type;};
+
+// Operator defined by its columns
+// Scalar is float, double, std::complex<float> or std::complex<double>,
+// complex operators are Hermitian
+template<typename Scalar_>
+class MatrixFreeOperatorT : public Eigen::EigenBase<MatrixFreeOperatorT<Scalar_>>
 {
 	public: 
 
-		typedef double Scalar;
-		typedef double RealScalar;
+		typedef Scalar_ Scalar;
+		typedef typename Eigen::NumTraits<Scalar>::Real RealScalar;
+		typedef typename SinglePrecision<Scalar>::type SingleScalar;
 		typedef int StorageIndex;
+		typedef Eigen::Index Index;
+
+		typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+		typedef Eigen::Matrix<Scalar,Eigen::Dynamic,1> VectorX;
+		typedef Eigen::Matrix<SingleScalar,Eigen::Dynamic,Eigen::Dynamic> MatrixXs;
 
 		enum {
 			ColsAtCompileTime = Eigen::Dynamic,
@@ -31,26 +47,61 @@ class MatrixFreeOperator : public Eigen::EigenBase<Eigen::MatrixXd>
 		Index cols() const {return this-> _size;}
 
 		template<typename Vtype>
-		Eigen::Product<MatrixFreeOperator,Vtype,Eigen::AliasFreeProduct> operator*(const Eigen::MatrixBase<Vtype>& x) const {
-			return Eigen::Product<MatrixFreeOperator,Vtype,Eigen::AliasFreeProduct>(*this, x.derived());
+		Eigen::Product<MatrixFreeOperatorT,Vtype,Eigen::AliasFreeProduct> operator*(const Eigen::MatrixBase<Vtype>& x) const {
+			return Eigen::Product<MatrixFreeOperatorT,Vtype,Eigen::AliasFreeProduct>(*this, x.derived());
 		}
 
 		// custom API
-		MatrixFreeOperator();
+		MatrixFreeOperatorT();
+		virtual ~MatrixFreeOperatorT() {}
 
 		// convenience function
-		Eigen::MatrixXd get_full_mat() const;
-		Eigen::VectorXd diagonal() const;
+		MatrixX get_full_mat() const;
 		int get_size() const {return this->_size;}
 		void set_size(int N) {this->_size = N;}
 
 		// extract row/col of the operator
-		virtual Eigen::VectorXd col(int index) const = 0;	
-		Eigen::VectorXd diag_el;	
+		// col() is called concurrently by several threads and must be thread safe
+		virtual VectorX col(int index) const = 0;	
+		VectorX diag_el;	
+
+		// diagonal of the operator
+		// the default implementation extracts the elements from col()
+		virtual Scalar diagonal_element(int index) const;
+		virtual VectorX diagonal() const;
+
+		// apply the operator to a block of vectors : Y = A * X
+		// the default implementation generates each column once, in parallel
+		// derived classes should override it with a dedicated kernel
+		virtual void apply(const Eigen::Ref<const MatrixX>& X, Eigen::Ref<MatrixX> Y) const;
+
+		// same product in single precision, used by the mixed precision solver
+		// the default implementation generates the panels in the precision
+		// of the operator and does the product in single precision
+		virtual void apply_single(const Eigen::Ref<const MatrixXs>& X, Eigen::Ref<MatrixXs> Y) const;
+
+		void set_panel_size(int N) {this->_panel_size = N;}
 
 	protected:
 
 		int _size;
+
+		// number of columns generated at once by each thread in apply()
+		int _panel_size = 64;
+
+		// fill panel with the columns start:start+panel.cols() of the operator
+		// the columns are distributed over the OpenMP threads
+		virtual void _fill_panel(int start, Eigen::Ref<MatrixX> panel) const;
+};
+
+typedef MatrixFreeOperatorT<double> MatrixFreeOperator;
+
+// true for the operators derived from MatrixFreeOperatorT
+template<typename MatrixReplacement>
+struct IsMatrixFreeOperator
+{
+	typedef typename std::remove_const<MatrixReplacement>::type Op;
+	static const bool value = std::is_base_of<MatrixFreeOperatorT<typename Op::Scalar>,Op>::value;
 };
 
 namespace Eigen{
@@ -58,54 +109,93 @@ namespace Eigen{
 	namespace internal{
 
 		// replacement of the mat*vect operation
-		template<typename Vtype>
-		struct generic_product_impl<MatrixFreeOperator, Vtype, DenseShape, DenseShape, GemvProduct> 
-		: generic_product_impl_base<MatrixFreeOperator,Vtype,generic_product_impl<MatrixFreeOperator,Vtype>>
+		template<typename S, typename Vtype>
+		struct generic_product_impl<MatrixFreeOperatorT<S>, Vtype, DenseShape, DenseShape, GemvProduct> 
+		: generic_product_impl_base<MatrixFreeOperatorT<S>,Vtype,generic_product_impl<MatrixFreeOperatorT<S>,Vtype>>
 		{
 
-			typedef typename Product<MatrixFreeOperator,Vtype>::Scalar Scalar;
+			typedef typename Product<MatrixFreeOperatorT<S>,Vtype>::Scalar Scalar;
+
+			template<typename Dest>
+			static void evalTo(Dest& dst, const MatrixFreeOperatorT<S>& op, const Vtype &v)
+			{
+				// returns dst = op * v
+				op.apply(v,dst);
+			}
 
 			template<typename Dest>
-			static void scaleAndAddTo(Dest& dst, const MatrixFreeOperator& op, const Vtype &v, const Scalar& alpha)
+			static void scaleAndAddTo(Dest& dst, const MatrixFreeOperatorT<S>& op, const Vtype &v, const Scalar& alpha)
 			{
-				//returns dst = alpha * op * v
-				// alpha must be 1 here
-				assert(alpha==Scalar(1) && "scaling is not implemented");
-				EIGEN_ONLY_USED_FOR_DEBUG(alpha);
-
-				// make the mat vect product
-				for (int i=0; i<op.cols(); i++)
-					dst += v(i) * op.col(i);
+				//returns dst += alpha * op * v
+				typename MatrixFreeOperatorT<S>::VectorX tmp(op.rows());
+				op.apply(v,tmp);
+				dst += alpha * tmp;
 			}
 		};
 
 		// replacement of the operator*matrix operation
-		template<typename Mtype>
-		struct generic_product_impl<MatrixFreeOperator, Mtype, DenseShape, DenseShape, GemmProduct> 
-		: generic_product_impl_base<MatrixFreeOperator, Mtype, generic_product_impl<MatrixFreeOperator,Mtype>>
+		template<typename S, typename Mtype>
+		struct generic_product_impl<MatrixFreeOperatorT<S>, Mtype, DenseShape, DenseShape, GemmProduct> 
+		: generic_product_impl_base<MatrixFreeOperatorT<S>, Mtype, generic_product_impl<MatrixFreeOperatorT<S>,Mtype>>
 		{
 
-			typedef typename Product<MatrixFreeOperator,Mtype>::Scalar Scalar;
+			typedef typename Product<MatrixFreeOperatorT<S>,Mtype>::Scalar Scalar;
 
 			template<typename Dest>
-			static void scaleAndAddTo(Dest& dst, const MatrixFreeOperator& op, const Mtype &m, const Scalar& alpha)
+			static void evalTo(Dest& dst, const MatrixFreeOperatorT<S>& op, const Mtype &m)
 			{
-				//returns dst = alpha * op * v
-				// alpha must be 1 here
-				assert(alpha==Scalar(1) && "scaling is not implemented");
-				EIGEN_ONLY_USED_FOR_DEBUG(alpha);
-
-				// make the mat vect product
-				for (int i=0; i<op.cols();i++)
-				{
-					for (int j=0; j<m.cols(); j++)
-						dst.col(j) += m(i,j) * op.col(i);	
-				}
-					
+				// returns dst = op * m
+				op.apply(m,dst);
+			}
+
+			template<typename Dest>
+			static void scaleAndAddTo(Dest& dst, const MatrixFreeOperatorT<S>& op, const Mtype &m, const Scalar& alpha)
+			{
+				//returns dst += alpha * op * m
+				typename MatrixFreeOperatorT<S>::MatrixX tmp(op.rows(),m.cols());
+				op.apply(m,tmp);
+				dst += alpha * tmp;
 			}
 		};
 	}
 }
 
-#endif
+// Y = A * X in the precision of X
+// matrix free operators go through apply() or apply_single(),
+// Eigen matrices use their own product
+template<typename MatrixReplacement, typename Scalar, bool = IsMatrixFreeOperator<MatrixReplacement>::value>
+struct OperatorProduct
+{
+	typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+
+	static void apply(const MatrixReplacement &A, const Eigen::Ref<const MatrixX> &X, Eigen::Ref<MatrixX> Y)
+	{
+		Y.noalias() = A * X;
+	}
+};
+
+template<typename MatrixReplacement, typename Scalar>
+struct OperatorProduct<MatrixReplacement,Scalar,true>
+{
+	typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+	typedef typename std::remove_const<MatrixReplacement>::type::Scalar OperatorScalar;
+
+	static void apply(const MatrixReplacement &A, const Eigen::Ref<const MatrixX> &X, Eigen::Ref<MatrixX> Y)
+	{
+		_apply(A,X,Y,std::is_same<Scalar,OperatorScalar>());
+	}
 
+	private:
+
+		static void _apply(const MatrixReplacement &A, const Eigen::Ref<const MatrixX> &X, Eigen::Ref<MatrixX> Y, std::true_type)
+		{
+			A.apply(X,Y);
+		}
+
+		static void _apply(const MatrixReplacement &A, const Eigen::Ref<const MatrixX> &X, Eigen::Ref<MatrixX> Y, std::false_type)
+		{
+			A.apply_single(X,Y);
+		}
+};
+
+#endif
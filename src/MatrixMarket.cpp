@@ -0,0 +1,125 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+
+#include "MatrixMarket.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+typedef Eigen::Triplet<double> Element;
+
+// parse the complete lines of [begin,end) : "row col [value]" with 1-based indices
+// returns false if an index is out of range
+static bool parse_lines(const char *begin, const char *end, bool pattern, bool symmetric, int rows, int cols, std::vector<Element> &elements)
+{
+    const char *p = begin;
+    while (p < end) {
+        const char *eol = std::find(p,end,'\n');
+        char *q;
+        long i = std::strtol(p,&q,10);
+        if (q != p and q < eol) {
+            long j = std::strtol(q,&q,10);
+            double value = pattern ? 1.0 : std::strtod(q,&q);
+            if (i < 1 or i > rows or j < 1 or j > cols) return false;
+            elements.push_back(Element(i-1,j-1,value));
+            if (symmetric and i != j) elements.push_back(Element(j-1,i-1,value));
+        }
+        p = eol + 1;
+    }
+    return true;
+}
+
+SparseOperator::SparseMatrix read_matrix_market(const std::string &filename, std::size_t chunk_size)
+{
+    std::ifstream infile(filename,std::ios::binary);
+    if (!infile) throw std::runtime_error("Can't open the matrix file " + filename);
+
+    // banner : %%MatrixMarket matrix coordinate <field> <symmetry>
+    std::string line, banner, object, format, field, symmetry;
+    std::getline(infile,line);
+    std::transform(line.begin(),line.end(),line.begin(),::tolower);
+    std::stringstream(line) >> banner >> object >> format >> field >> symmetry;
+    bool pattern = (field == "pattern");
+    bool symmetric = (symmetry == "symmetric");
+    if (banner != "%%matrixmarket" or object != "matrix" or format != "coordinate"
+        or !(field == "real" or field == "integer" or pattern)
+        or !(symmetric or symmetry == "general"))
+        throw std::runtime_error("Not a valid Matrix Market file " + filename + " (coordinate real symmetric/general only)");
+
+    // size line after the comments
+    while (std::getline(infile,line) and (line.empty() or line[0] == '%')) {}
+    int rows = 0, cols = 0;
+    long nnz = 0;
+    if (!(std::stringstream(line) >> rows >> cols >> nnz))
+        throw std::runtime_error("Not a valid Matrix Market file " + filename);
+
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    std::vector<std::vector<Element>> elements(nthreads);
+    for (auto &list : elements) list.reserve((symmetric ? 2 : 1) * nnz / nthreads + 1);
+
+    // blocks of complete lines, the incomplete last line is carried over
+    std::vector<char> chunk;
+    std::size_t carry = 0;
+    bool valid = true;
+    while (infile) {
+        // the block ends with a null character so that strtol/strtod stop in it
+        chunk.resize(carry + chunk_size + 1);
+        infile.read(chunk.data() + carry,chunk_size);
+        std::size_t nread = carry + infile.gcount();
+        chunk[nread] = '\0';
+        std::size_t nparse = nread;
+        if (infile) {
+            const char *last = std::find(std::reverse_iterator<const char*>(chunk.data()+nread),
+                                         std::reverse_iterator<const char*>(chunk.data()),'\n').base();
+            nparse = last - chunk.data();
+        }
+
+        // each thread parses a range of lines of the block
+        const char *data = chunk.data();
+        #pragma omp parallel num_threads(nthreads) reduction(&&:valid)
+        {
+            int tid = 0, nt = 1;
+#ifdef _OPENMP
+            tid = omp_get_thread_num();
+            nt = omp_get_num_threads();
+#endif
+            const char *begin = data + nparse * tid / nt;
+            const char *end = data + nparse * (tid+1) / nt;
+            if (tid > 0) begin = std::find(begin-1,data+nparse,'\n') + 1;
+            if (tid < nt-1) end = std::find(end-1,data+nparse,'\n') + 1;
+            if (begin < end) valid = parse_lines(begin,std::min(end,data+nparse),pattern,symmetric,rows,cols,elements[tid]);
+        }
+        if (!valid) throw std::runtime_error("Not a valid Matrix Market element in " + filename);
+
+        carry = nread - nparse;
+        std::copy(chunk.data()+nparse,chunk.data()+nread,chunk.data());
+    }
+
+    // merge the lists, each one is released once it has been copied
+    std::vector<Element> triplets;
+    std::size_t ntot = 0;
+    for (auto &list : elements) ntot += list.size();
+    triplets.reserve(ntot);
+    for (auto &list : elements) {
+        triplets.insert(triplets.end(),list.begin(),list.end());
+        std::vector<Element>().swap(list);
+    }
+
+    SparseOperator::SparseMatrix S(rows,cols);
+    S.setFromTriplets(triplets.begin(),triplets.end());
+    S.makeCompressed();
+    return S;
+}
@@ -0,0 +1,21 @@
+#include <iostream>
+#include <string>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+
+#include "SparseOperator.hpp"
+
+#ifndef _MATRIX_MARKET_
+#define _MATRIX_MARKET_
+
+// Matrix Market reader : coordinate format, real/integer/pattern values,
+// symmetric or general storage (the strict upper part of a symmetric
+// matrix is filled from the lower one)
+//
+// the file is streamed in blocks of chunk_size bytes that are parsed by
+// the OpenMP threads, so the memory used is the one of the elements and
+// of a single block
+SparseOperator::SparseMatrix read_matrix_market(const std::string &filename, std::size_t chunk_size = 1 << 26);
+
+#endif
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <complex>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include <Eigen/Eigenvalues>
+
+#include "Preconditioner.hpp"
+
+template<typename Scalar>
+DiagonalPreconditionerT<Scalar>::DiagonalPreconditionerT(const VectorX &Adiag)
+: _Adiag(Adiag), _Bdiag(VectorX::Ones(Adiag.size())) {}
+
+template<typename Scalar>
+DiagonalPreconditionerT<Scalar>::DiagonalPreconditionerT(const VectorX &Adiag, const VectorX &Bdiag)
+: _Adiag(Adiag), _Bdiag(Bdiag) {}
+
+template<typename Scalar>
+void DiagonalPreconditionerT<Scalar>::apply(Eigen::Ref<MatrixX> R, const RealVectorX &lambda) const
+{
+    // in place : r = (A0 - lambda B0)^{-1} r
+    for (int i=0; i<R.cols(); i++) {
+        R.col(i).array() /= (this->_Adiag.array() - Scalar(lambda(i)) * this->_Bdiag.array());
+    }
+}
+
+template<typename Scalar>
+ClampedDiagonalPreconditionerT<Scalar>::ClampedDiagonalPreconditionerT(const VectorX &Adiag, double clamp)
+: DiagonalPreconditionerT<Scalar>(Adiag), _clamp(clamp) {}
+
+template<typename Scalar>
+ClampedDiagonalPreconditionerT<Scalar>::ClampedDiagonalPreconditionerT(const VectorX &Adiag, const VectorX &Bdiag, double clamp)
+: DiagonalPreconditionerT<Scalar>(Adiag,Bdiag), _clamp(clamp) {}
+
+template<typename Scalar>
+void ClampedDiagonalPreconditionerT<Scalar>::apply(Eigen::Ref<MatrixX> R, const RealVectorX &lambda) const
+{
+    // the (real) denominators smaller than clamp keep their sign
+    RealVectorX d(R.rows());
+    for (int i=0; i<R.cols(); i++) {
+        d = (this->_Adiag.array() - Scalar(lambda(i)) * this->_Bdiag.array()).real();
+        for (int k=0; k<d.size(); k++) {
+            if (std::abs(d(k)) < this->_clamp) d(k) = (d(k) < 0) ? -this->_clamp : this->_clamp;
+        }
+        R.col(i).array() /= d.array().template cast<Scalar>();
+    }
+}
+
+template<typename Scalar>
+void BlockDiagonalPreconditionerT<Scalar>::_factorize(const std::vector<MatrixX> &Ablocks, const std::vector<MatrixX> &Bblocks)
+{
+    int nblocks = Ablocks.size();
+    this->_start.resize(nblocks);
+    this->_Q.resize(nblocks);
+    this->_L.resize(nblocks);
+
+    int start = 0;
+    #pragma omp parallel for schedule(dynamic)
+    for (int k=0; k<nblocks; k++) {
+        if (Bblocks.empty()) {
+            Eigen::SelfAdjointEigenSolver<MatrixX> es(Ablocks[k]);
+            this->_Q[k] = es.eigenvectors();
+            this->_L[k] = es.eigenvalues();
+        }
+        else {
+            Eigen::GeneralizedSelfAdjointEigenSolver<MatrixX> es(Ablocks[k],Bblocks[k]);
+            this->_Q[k] = es.eigenvectors();
+            this->_L[k] = es.eigenvalues();
+        }
+    }
+    for (int k=0; k<nblocks; k++) {
+        this->_start[k] = start;
+        start += Ablocks[k].rows();
+    }
+}
+
+template<typename Scalar>
+void BlockDiagonalPreconditionerT<Scalar>::apply(Eigen::Ref<MatrixX> R, const RealVectorX &lambda) const
+{
+    // in place : r_k = Q_k (L_k - lambda)^{-1} Q_k^H r_k for each block k
+    int nblocks = this->_Q.size();
+    #pragma omp parallel for schedule(static)
+    for (int k=0; k<nblocks; k++) {
+        int n = this->_Q[k].rows();
+        auto Rk = R.middleRows(this->_start[k],n);
+        MatrixX Y = this->_Q[k].adjoint() * Rk;
+        for (int i=0; i<R.cols(); i++) {
+            for (int l=0; l<n; l++) {
+                RealScalar d = this->_L[k](l) - lambda(i);
+                if (std::abs(d) < this->_clamp) d = (d < 0) ? -this->_clamp : this->_clamp;
+                Y(l,i) /= d;
+            }
+        }
+        Rk.noalias() = this->_Q[k] * Y;
+    }
+}
+
+template class PreconditionerT<float>;
+template class PreconditionerT<double>;
+template class PreconditionerT<std::complex<float>>;
+template class PreconditionerT<std::complex<double>>;
+template class DiagonalPreconditionerT<float>;
+template class DiagonalPreconditionerT<double>;
+template class DiagonalPreconditionerT<std::complex<float>>;
+template class DiagonalPreconditionerT<std::complex<double>>;
+template class ClampedDiagonalPreconditionerT<float>;
+template class ClampedDiagonalPreconditionerT<double>;
+template class ClampedDiagonalPreconditionerT<std::complex<float>>;
+template class ClampedDiagonalPreconditionerT<std::complex<double>>;
+template class BlockDiagonalPreconditionerT<float>;
+template class BlockDiagonalPreconditionerT<double>;
+template class BlockDiagonalPreconditionerT<std::complex<float>>;
+template class BlockDiagonalPreconditionerT<std::complex<double>>;
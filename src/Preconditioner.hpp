@@ -0,0 +1,143 @@
+#include <iostream>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+
+#ifndef _PRECONDITIONER_
+#define _PRECONDITIONER_
+
+// Preconditioner of the Davidson corrections
+// M(lambda) approximates A - lambda B and apply() replaces a block of
+// residues by M(lambda)^{-1} R, column i being shifted by lambda(i)
+template<typename Scalar>
+class PreconditionerT
+{
+	public:
+
+		typedef typename Eigen::NumTraits<Scalar>::Real RealScalar;
+		typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+		typedef Eigen::Matrix<Scalar,Eigen::Dynamic,1> VectorX;
+		typedef Eigen::Matrix<RealScalar,Eigen::Dynamic,1> RealVectorX;
+
+		virtual ~PreconditionerT() {}
+
+		virtual void apply(Eigen::Ref<MatrixX> R, const RealVectorX &lambda) const = 0;
+};
+
+// M(lambda) = diag(A) - lambda diag(B)
+template<typename Scalar>
+class DiagonalPreconditionerT : public PreconditionerT<Scalar>
+{
+	public:
+
+		typedef typename PreconditionerT<Scalar>::RealScalar RealScalar;
+		typedef typename PreconditionerT<Scalar>::MatrixX MatrixX;
+		typedef typename PreconditionerT<Scalar>::VectorX VectorX;
+		typedef typename PreconditionerT<Scalar>::RealVectorX RealVectorX;
+
+		// diag(B) is one for the standard problem
+		DiagonalPreconditionerT(const VectorX &Adiag);
+		DiagonalPreconditionerT(const VectorX &Adiag, const VectorX &Bdiag);
+
+		void apply(Eigen::Ref<MatrixX> R, const RealVectorX &lambda) const;
+
+	protected:
+
+		VectorX _Adiag;
+		VectorX _Bdiag;
+};
+
+// diagonal preconditioner whose denominators are kept away from zero :
+// |diag(A) - lambda diag(B)| >= clamp
+template<typename Scalar>
+class ClampedDiagonalPreconditionerT : public DiagonalPreconditionerT<Scalar>
+{
+	public:
+
+		typedef typename PreconditionerT<Scalar>::RealScalar RealScalar;
+		typedef typename PreconditionerT<Scalar>::MatrixX MatrixX;
+		typedef typename PreconditionerT<Scalar>::VectorX VectorX;
+		typedef typename PreconditionerT<Scalar>::RealVectorX RealVectorX;
+
+		ClampedDiagonalPreconditionerT(const VectorX &Adiag, double clamp = 1E-3);
+		ClampedDiagonalPreconditionerT(const VectorX &Adiag, const VectorX &Bdiag, double clamp = 1E-3);
+
+		void apply(Eigen::Ref<MatrixX> R, const RealVectorX &lambda) const;
+
+	private:
+
+		RealScalar _clamp;
+};
+
+// M(lambda) is the block diagonal of A - lambda B with dense blocks of
+// block_size consecutive rows. The pencil of each block is diagonalized once
+//
+//		A_k Q_k = B_k Q_k L_k		Q_k^H B_k Q_k = I
+//
+// so that M(lambda)^{-1} = Q_k (L_k - lambda)^{-1} Q_k^H for any lambda.
+// The denominators are clamped like in ClampedDiagonalPreconditionerT.
+template<typename Scalar>
+class BlockDiagonalPreconditionerT : public PreconditionerT<Scalar>
+{
+	public:
+
+		typedef typename PreconditionerT<Scalar>::RealScalar RealScalar;
+		typedef typename PreconditionerT<Scalar>::MatrixX MatrixX;
+		typedef typename PreconditionerT<Scalar>::VectorX VectorX;
+		typedef typename PreconditionerT<Scalar>::RealVectorX RealVectorX;
+
+		// A (and B) are dense matrices or matrix free operators,
+		// the blocks are read from their columns
+		template<typename MatrixReplacement>
+		BlockDiagonalPreconditionerT(const MatrixReplacement &A, int block_size, double clamp = 1E-3)
+		: _clamp(clamp)
+		{
+			std::vector<MatrixX> Ablocks = BlockDiagonalPreconditionerT::_extract_blocks(A,block_size);
+			this->_factorize(Ablocks,std::vector<MatrixX>());
+		}
+
+		template<typename MatrixReplacement, typename MatrixReplacementB>
+		BlockDiagonalPreconditionerT(const MatrixReplacement &A, const MatrixReplacementB &B, int block_size, double clamp = 1E-3)
+		: _clamp(clamp)
+		{
+			std::vector<MatrixX> Ablocks = BlockDiagonalPreconditionerT::_extract_blocks(A,block_size);
+			std::vector<MatrixX> Bblocks = BlockDiagonalPreconditionerT::_extract_blocks(B,block_size);
+			this->_factorize(Ablocks,Bblocks);
+		}
+
+		void apply(Eigen::Ref<MatrixX> R, const RealVectorX &lambda) const;
+
+		int nblocks() const {return this->_Q.size();}
+
+	private:
+
+		RealScalar _clamp;
+		std::vector<int> _start;
+		std::vector<MatrixX> _Q;
+		std::vector<RealVectorX> _L;
+
+		template<typename MatrixReplacement>
+		static std::vector<MatrixX> _extract_blocks(const MatrixReplacement &A, int block_size)
+		{
+		    int size = A.rows();
+		    std::vector<MatrixX> blocks;
+		    for (int start=0; start<size; start+=block_size) {
+		        int n = std::min(block_size,size-start);
+		        MatrixX block(n,n);
+		        for (int j=0; j<n; j++) {
+		            block.col(j) = A.col(start+j).segment(start,n).template cast<Scalar>();
+		        }
+		        blocks.push_back(block);
+		    }
+		    return blocks;
+		}
+
+		void _factorize(const std::vector<MatrixX> &Ablocks, const std::vector<MatrixX> &Bblocks);
+};
+
+typedef PreconditionerT<double> Preconditioner;
+typedef DiagonalPreconditionerT<double> DiagonalPreconditioner;
+typedef ClampedDiagonalPreconditionerT<double> ClampedDiagonalPreconditioner;
+typedef BlockDiagonalPreconditionerT<double> BlockDiagonalPreconditioner;
+
+#endif
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+#include "SparseOperator.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// constructors
+SparseOperator::SparseOperator(const MatrixFreeOperator &A, double drop_tol)
+{
+    _size = A.rows();
+
+    // each thread scans a contiguous range of columns and keeps its
+    // own list of elements, the diagonal is always kept
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    std::vector<std::vector<Eigen::Triplet<double>>> elements(nthreads);
+
+    #pragma omp parallel
+    {
+        int tid = 0;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+#endif
+        #pragma omp for schedule(static)
+        for (int i=0; i<_size; i++) {
+            Eigen::VectorXd col_data = A.col(i);
+            for (int j=0; j<_size; j++) {
+                if (j==i or std::abs(col_data(j)) > drop_tol)
+                    elements[tid].push_back(Eigen::Triplet<double>(j,i,col_data(j)));
+            }
+        }
+    }
+
+    // merge the lists in thread order
+    std::vector<Eigen::Triplet<double>> triplets;
+    for (auto &list : elements)
+        triplets.insert(triplets.end(),list.begin(),list.end());
+
+    _matrix.resize(_size,_size);
+    _matrix.setFromTriplets(triplets.begin(),triplets.end());
+    _matrix.makeCompressed();
+}
+
+SparseOperator::SparseOperator(const SparseMatrix &S)
+{
+    _size = S.rows();
+    _matrix = S;
+    _matrix.makeCompressed();
+}
+
+// the matrix is moved : no copy of large operators
+SparseOperator::SparseOperator(SparseMatrix &&S)
+{
+    _size = S.rows();
+    _matrix.swap(S);
+    _matrix.makeCompressed();
+}
+
+//  get a col of the operator
+//  the operator is symmetric : the col is read from the CSR row
+Eigen::VectorXd SparseOperator::col(int index) const
+{
+    return _matrix.row(index).transpose();
+}
+
+double SparseOperator::diagonal_element(int index) const
+{
+    return _matrix.coeff(index,index);
+}
+
+Eigen::VectorXd SparseOperator::diagonal() const
+{
+    return _matrix.diagonal();
+}
+
+// sparse matrix product : Y = A * X
+// the rows of the CSR matrix are distributed over the OpenMP threads by Eigen
+void SparseOperator::apply(const Eigen::Ref<const Eigen::MatrixXd>& X, Eigen::Ref<Eigen::MatrixXd> Y) const
+{
+    Y.noalias() = _matrix * X;
+}
+
+// single precision product
+// the rounded copy of the matrix is made once and reused
+void SparseOperator::apply_single(const Eigen::Ref<const Eigen::MatrixXf>& X, Eigen::Ref<Eigen::MatrixXf> Y) const
+{
+    if (_matrix_single.nonZeros() != _matrix.nonZeros()) {
+        _matrix_single = _matrix.cast<float>();
+        _matrix_single.makeCompressed();
+    }
+    Y.noalias() = _matrix_single * X;
+}
@@ -0,0 +1,41 @@
+#include <iostream>
+#include <Eigen/Dense>
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+#include "MatrixFreeOperator.hpp"
+
+#ifndef _SPARSE_OP_
+#define _SPARSE_OP_
+
+// Operator stored as a sparse (CSR) matrix
+// It can be built from any matrix free operator by dropping the elements
+// below a given tolerance and is used by the solver as a MatrixFreeOperator
+class SparseOperator : public MatrixFreeOperator
+{
+	public:
+
+		typedef Eigen::SparseMatrix<double,Eigen::RowMajor> SparseMatrix;
+		typedef Eigen::SparseMatrix<float,Eigen::RowMajor> SparseMatrixSingle;
+
+		SparseOperator(const MatrixFreeOperator &A, double drop_tol);
+		SparseOperator(const SparseMatrix &S);
+		SparseOperator(SparseMatrix &&S);
+
+		Eigen::VectorXd col(int index) const;
+		double diagonal_element(int index) const;
+		Eigen::VectorXd diagonal() const;
+		void apply(const Eigen::Ref<const Eigen::MatrixXd>& X, Eigen::Ref<Eigen::MatrixXd> Y) const;
+		void apply_single(const Eigen::Ref<const Eigen::MatrixXf>& X, Eigen::Ref<Eigen::MatrixXf> Y) const;
+
+		const SparseMatrix& matrix() const {return this->_matrix;}
+		int nonZeros() const {return this->_matrix.nonZeros();}
+
+	private:
+
+		SparseMatrix _matrix;
+
+		// single precision copy, built on the first call to apply_single()
+		mutable SparseMatrixSingle _matrix_single;
+};
+
+#endif
@@ -4,11 +4,16 @@
 #include <Eigen/QR>
 #include <Eigen/Eigenvalues>
 #include <chrono>
+#include <memory>
 #include <cxxopts.hpp>
 
 #include "DavidsonSolver.hpp"
 #include "DavidsonOperator.hpp"
 #include "MatrixFreeOperator.hpp"
+#include "SparseOperator.hpp"
+#include "MappedMatrix.hpp"
+#include "MatrixMarket.hpp"
+#include "DistributedDavidson.hpp"
 
 
 #include <iostream>
@@ -17,52 +22,21 @@
 
 using namespace std;
 
-#define MAXBUFSIZE  ((int) 1e6)
-
-Eigen::MatrixXd readMatrix(const char *filename)
-    {
-    int cols = 0, rows = 0;
-    double buff[MAXBUFSIZE];
-
-    // Read numbers from file into buffer.
-    ifstream infile;
-    infile.open(filename);
-    while (! infile.eof())
-        {
-        string line;
-        getline(infile, line);
-
-        int temp_cols = 0;
-        stringstream stream(line);
-        while(! stream.eof())
-            stream >> buff[cols*rows+temp_cols++];
-
-        if (temp_cols == 0)
-            continue;
-
-        if (cols == 0)
-            cols = temp_cols;
-
-        rows++;
-        }
-
-    infile.close();
-
-    rows--;
-
-    // Populate matrix with numbers.
-    Eigen::MatrixXd result(rows,cols);
-    for (int i = 0; i < rows; i++)
-        for (int j = 0; j < cols; j++)
-            result(i,j) = buff[ cols*i+j ];
-
-    return result;
-    };
-
-
+#ifdef USE_MPI
+// MPI is initialized for the whole run, the ranks only cooperate with --distributed
+struct MPIEnvironment
+{
+    MPIEnvironment(int &argc, char **&argv) {MPI_Init(&argc,&argv);}
+    ~MPIEnvironment() {MPI_Finalize();}
+};
+#endif
 
 int main (int argc, char *argv[]){
 
+#ifdef USE_MPI
+    MPIEnvironment mpi(argc,argv);
+#endif
+
     // parse the input
     cxxopts::Options options(argv[0],  "Eigen Davidson Iterative Solver");
     options.positional_help("[optional args]").show_positional_help();
@@ -72,13 +46,27 @@ int main (int argc, char *argv[]){
         ("neigen", "number of eigenvalues required", cxxopts::value<std::string>()->default_value("5"))
         ("corr", "correction method", cxxopts::value<std::string>()->default_value("DPR"))
         ("mf", "use matrix free", cxxopts::value<bool>())
+        ("sparse", "use a sparse operator", cxxopts::value<bool>())
+        ("droptol", "drop tolerance of the sparse operator", cxxopts::value<std::string>()->default_value("1E-8"))
+        ("noref", "skip the reference dense diagonalization", cxxopts::value<bool>())
         ("diag", "diagonal elements are ordered" , cxxopts::value<bool>())
         ("reorder", "reorder diagonal elements" , cxxopts::value<bool>())
         ("linsolve", "method to solve the linear system of JOCC (CG, GMRES, LLT)", cxxopts::value<std::string>()->default_value("CG"))
         ("init", "method to itialize the eigenvector (target, indentity, random)", cxxopts::value<std::string>()->default_value("target"))
         ("tol", "tolerance on the residue norm", cxxopts::value<std::string>()->default_value("1E-4"))
         ("lstol", "tolerance of the linear solver", cxxopts::value<std::string>()->default_value("0.01"))
+        ("threads", "number of threads (0: OpenMP default)", cxxopts::value<std::string>()->default_value("0"))
+        ("mixed", "single precision iterations before the double precision ones", cxxopts::value<bool>())
+        ("target", "compute the eigenvalues closest to the target", cxxopts::value<std::string>())
+        ("ooc", "directory of the out of core search space", cxxopts::value<std::string>())
+        ("matrix", "binary matrix file used instead of the generated matrix", cxxopts::value<std::string>())
+        ("convert", "convert a text matrix to the binary file given by --matrix", cxxopts::value<std::string>())
+        ("mtx", "Matrix Market file solved as a sparse matrix free operator", cxxopts::value<std::string>())
         ("help", "Print the help", cxxopts::value<bool>());
+#ifdef USE_MPI
+    options.add_options()
+        ("distributed", "row-partitioned solve over the MPI ranks (generated or --mtx operator)", cxxopts::value<bool>());
+#endif
     auto result = options.parse(argc,argv);
 
     if (result.count("help"))
@@ -91,6 +79,10 @@ int main (int argc, char *argv[]){
     int size = std::stoi(result["size"].as<std::string>(),nullptr);
     int neigen = std::stoi(result["neigen"].as<std::string>(),nullptr);
     bool mf = result["mf"].as<bool>();
+    bool sparse = result["sparse"].as<bool>();
+    bool noref = result["noref"].as<bool>();
+    bool mixed = result["mixed"].as<bool>();
+    double droptol = std::stod(result["droptol"].as<std::string>(),nullptr);
     bool odiag = result["diag"].as<bool>();
     bool reorder = result["reorder"].as<bool>();
     std::string linsolve = result["linsolve"].as<std::string>();
@@ -100,6 +92,35 @@ int main (int argc, char *argv[]){
     double eps = std::stod(result["eps"].as<std::string>(),nullptr);
     double davidson_tol = std::stod(result["tol"].as<std::string>(),nullptr);
     double lsolve_tol = std::stod(result["lstol"].as<std::string>(),nullptr);
+    int nthreads = std::stoi(result["threads"].as<std::string>(),nullptr);
+    if (nthreads > 0) Eigen::setNbThreads(nthreads);
+
+    // text matrices are only converted to the binary format
+    if (result.count("convert")) {
+        if (!result.count("matrix")) {
+            std::cout << "--convert requires the output file --matrix" << std::endl;
+            return 1;
+        }
+        Eigen::MatrixXd Atxt = read_text_matrix(result["convert"].as<std::string>());
+        MappedMatrix::write(result["matrix"].as<std::string>(),Atxt);
+        std::cout << "Matrix " << Atxt.rows() << "x" << Atxt.cols() << " written to " << result["matrix"].as<std::string>() << std::endl;
+        return 0;
+    }
+
+    // binary matrix, mapped without copy
+    std::unique_ptr<MappedMatrix> Amapped;
+    if (result.count("matrix")) {
+        Amapped.reset(new MappedMatrix(result["matrix"].as<std::string>()));
+        size = Amapped->matrix().rows();
+    }
+
+    // Matrix Market file, read in a sparse operator
+    std::unique_ptr<SparseOperator> Amtx;
+    if (result.count("mtx")) {
+        Amtx.reset(new SparseOperator(read_matrix_market(result["mtx"].as<std::string>())));
+        size = Amtx->rows();
+        std::cout << "Matrix Market operator : " << Amtx->nonZeros() << " non zeros" << std::endl;
+    }
 
     // chrono    
     std::chrono::time_point<std::chrono::system_clock> start, end;
@@ -110,29 +131,100 @@ int main (int argc, char *argv[]){
     std::cout << "eps : " <<  eps << std::endl;
 
     // Create Operator
+    // the dense matrix is only needed for the dense solve and the reference
     DavidsonOperator Aop(size,eps,odiag,reorder);
-    Eigen::MatrixXd Afull = Aop.get_full_mat();
-    std::cout << "Afull" << std::endl << Afull.block(0,0,5,5) << std::endl;
+
+#ifdef USE_MPI
+    // distributed solve : each rank keeps its rows of the operator
+    if (result["distributed"].as<bool>()) {
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+        std::unique_ptr<DistributedOperator> Adist;
+        if (Amtx) Adist.reset(new DistributedOperator(Amtx->matrix()));
+        else Adist.reset(new DistributedOperator(Aop,droptol));
+
+        DistributedDavidsonSolver DDS;
+        DDS.set_verbose(true);
+        DDS.set_tolerance(davidson_tol);
+        start = std::chrono::system_clock::now();
+        DDS.solve(*Adist,neigen);
+        end = std::chrono::system_clock::now();
+        elapsed_time = end-start;
+
+        if (rank == 0) {
+            std::cout << std::endl << "Davidson               : " << elapsed_time.count() << " secs" <<  std::endl;
+            std::cout << std::endl <<  "      Davidson" << std::endl;
+            for(int i=0; i< neigen; i++)
+                printf("#% 4d %8.7f\n",i,DDS.eigenvalues()(i));
+        }
+        return 0;
+    }
+#endif
+    bool dense = !(mf or sparse);
+    Eigen::MatrixXd Afull;
+    if (Amapped) {
+        if (!noref) Afull = Amapped->matrix();
+    }
+    else if (Amtx) {
+        if (!noref) Afull = Amtx->matrix();
+    }
+    else if (dense or !noref) {
+        Afull = Aop.get_full_mat();
+        std::cout << "Afull" << std::endl << Afull.block(0,0,5,5) << std::endl;
+    }
 
     // Davidosn Solver
     start = std::chrono::system_clock::now();
     DavidsonSolver DS;
 
+    DS.set_verbose(true);
     DS.set_guess_vectors(eigen_init);
     DS.set_correction(correction);
     DS.set_tolerance(davidson_tol);
+    DS.set_num_threads(nthreads);
+    DS.set_mixed_precision(mixed);
+    if (result.count("target")) DS.set_target(std::stod(result["target"].as<std::string>(),nullptr));
+    if (result.count("ooc")) DS.set_out_of_core(result["ooc"].as<std::string>());
 
     if (correction == "JACOBI") {
         DS.set_jacobi_linsolve(linsolve);
         DS.set_linsolve_tol(lsolve_tol);
     }
 
-    if (mf) DS.solve(Aop,neigen);
+    if (Amapped) {
+        MappedMatrix::ConstMap Amap = Amapped->matrix();
+        DS.solve(Amap,neigen);
+    }
+    else if (Amtx) DS.solve(*Amtx,neigen);
+    else if (sparse) {
+        SparseOperator Asp(Aop,droptol);
+        std::cout << "Sparse operator : " << Asp.nonZeros() << " non zeros ("
+                  << 100.0*Asp.nonZeros()/(static_cast<double>(size)*size) << "%)" << std::endl;
+        DS.solve(Asp,neigen);
+    }
+    else if (mf) DS.solve(Aop,neigen);
     else  DS.solve(Afull,neigen);
     
     end = std::chrono::system_clock::now();
     elapsed_time = end-start;
     std::cout << std::endl << "Davidson               : " << elapsed_time.count() << " secs" <<  std::endl;
+
+    // time spent in each phase of the solver
+    const DavidsonStatistics &stats = DS.statistics();
+    printf("  operator products     : %8.4f secs (%ld vectors)\n",stats.apply.time,stats.apply.count);
+    printf("  subspace diag.        : %8.4f secs\n",stats.subspace.time);
+    printf("  corrections           : %8.4f secs (%ld vectors)\n",stats.correction.time,stats.correction.count);
+    printf("  orthogonalization     : %8.4f secs\n",stats.orthogonalization.time);
+    if (correction == "JACOBI")
+        printf("  linear systems        : %8.4f secs (%ld iterations)\n",stats.linsolve.time,stats.linsolve.count);
+
+    auto dseigop = DS.eigenvalues();
+    if (noref) {
+        std::cout << std::endl <<  "      Davidson" << std::endl;
+        for(int i=0; i< neigen; i++)
+            printf("#% 4d %8.7f\n",i,dseigop(i));
+        return 0;
+    }
     
     // normal eigensolver
     start = std::chrono::system_clock::now();
@@ -141,8 +233,13 @@ int main (int argc, char *argv[]){
     elapsed_time = end-start;
     std::cout << "Eigen                  : " << elapsed_time.count() << " secs" <<  std::endl;
     
-    auto dseigop = DS.eigenvalues();
-    auto eig2 = es2.eigenvalues().head(neigen);
+    // reference eigenvalues closest to the target
+    Eigen::VectorXd eig2 = es2.eigenvalues();
+    if (result.count("target")) {
+        double sigma = std::stod(result["target"].as<std::string>(),nullptr);
+        std::sort(eig2.data(),eig2.data()+eig2.size(),
+                  [&](double a, double b){return std::abs(a-sigma)<std::abs(b-sigma);});
+    }
     std::cout << std::endl <<  "      Davidson  \tEigen \t\t Error" << std::endl;
     for(int i=0; i< neigen; i++)
         printf("#% 4d %8.7f \t%8.7f \t %4.2e\n",i,dseigop(i),eig2(i),abs(eig2(i)-dseigop(i)));
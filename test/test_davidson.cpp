@@ -10,10 +10,26 @@
 #include <Eigen/QR>
 #include <Eigen/Eigenvalues>
 #include <chrono>
+#include <fstream>
 
 #include "../src/DavidsonSolver.hpp"
 #include "../src/DavidsonOperator.hpp"
 #include "../src/MatrixFreeOperator.hpp"
+#include "../src/SparseOperator.hpp"
+#include "../src/MappedMatrix.hpp"
+#include "../src/MatrixMarket.hpp"
+#include "../src/DavidsonBatch.hpp"
+#include "../src/DistributedDavidson.hpp"
+
+#ifdef USE_MPI
+// MPI environment of the whole test module
+struct MPIFixture
+{
+    MPIFixture() {MPI_Init(nullptr,nullptr);}
+    ~MPIFixture() {MPI_Finalize();}
+};
+BOOST_GLOBAL_FIXTURE(MPIFixture);
+#endif
 
 // intiialize a full matrix 
 Eigen::MatrixXd init_matrix(int N, double eps, bool diag)
@@ -54,6 +70,31 @@ Eigen::VectorXd TestOperator::col(int index) const
     return col_out;
 }
 
+// complex hermitian matrix free operator
+class ComplexTestOperator : public MatrixFreeOperatorT<std::complex<double>>
+{
+    public : 
+    ComplexTestOperator(int n) {_size = n;}
+    Eigen::VectorXcd col(int index) const;
+};
+
+//  get a col of the operator : A(j,i) = conj(A(i,j))
+Eigen::VectorXcd ComplexTestOperator::col(int index) const
+{
+    Eigen::VectorXcd col_out = Eigen::VectorXcd::Zero(_size,1);    
+    for (int j=0; j < _size; j++)
+    {
+        if (j==index) {
+            col_out(j) = static_cast<double> (j+1); 
+        }
+        else{
+            double d = static_cast<double>(j-index);
+            col_out(j) = std::complex<double>(0.01,0.01*d/std::abs(d)) / (d*d);
+        }
+    }
+    return col_out;
+}
+
 //BOOST_AUTO_TEST_SUITE(davidson_test)
 
 BOOST_AUTO_TEST_CASE(davidson_full_matrix) {
@@ -97,6 +138,69 @@ BOOST_AUTO_TEST_CASE(olsen_full_matrix) {
 
 }
 
+BOOST_AUTO_TEST_CASE(davidson_many_roots) {
+
+    int size = 1000;
+    int neigen = 40;
+    double eps = 0.01;
+    Eigen::MatrixXd A = init_matrix(size,eps,true);
+
+    DavidsonSolver DS;
+    DS.solve(A,neigen);
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+
+    auto lambda = DS.eigenvalues();
+    auto lambda_ref = es.eigenvalues().head(neigen);
+    bool check_eigenvalues = lambda.isApprox(lambda_ref,1E-6);
+    
+    BOOST_CHECK_EQUAL(check_eigenvalues,1);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_thick_restart) {
+
+    int size = 1000;
+    int neigen = 5;
+    double eps = 0.01;
+    Eigen::MatrixXd A = init_matrix(size,eps,false);
+
+    DavidsonSolver DS;
+    DS.set_max_search_space(25);
+    DS.set_restart_size(10);
+    DS.set_restart_previous(5);
+    DS.solve(A,neigen);
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+
+    auto lambda = DS.eigenvalues();
+    auto lambda_ref = es.eigenvalues().head(neigen);
+    bool check_eigenvalues = lambda.isApprox(lambda_ref,1E-6);
+    
+    BOOST_CHECK_EQUAL(check_eigenvalues,1);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_orthogonalization) {
+
+    int size = 1000;
+    int neigen = 10;
+    double eps = 0.01;
+    Eigen::MatrixXd A = init_matrix(size,eps,false);
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+    auto lambda_ref = es.eigenvalues().head(neigen);
+
+    std::vector<std::string> methods = {"GS","QR","BCGS2"};
+    for (auto &method : methods) {
+        DavidsonSolver DS;
+        DS.set_orthogonalization(method);
+        DS.solve(A,neigen);
+
+        auto lambda = DS.eigenvalues();
+        bool check_eigenvalues = lambda.isApprox(lambda_ref,1E-6);
+        BOOST_CHECK_EQUAL(check_eigenvalues,1);
+    }
+
+}
+
 BOOST_AUTO_TEST_CASE(jacobi_full_matrix) {
 
     int size = 50;
@@ -185,4 +289,631 @@ BOOST_AUTO_TEST_CASE(jacobi_matrix_free) {
 
 }
 
+BOOST_AUTO_TEST_CASE(jacobi_gmres_matrix_free) {
+
+    int size = 200;
+    int neigen = 2;
+
+    TestOperator Aop(size);
+    DavidsonSolver DS;
+    DS.set_correction("JACOBI");
+    DS.set_jacobi_linsolve("GMRES");
+    DS.solve(Aop,neigen);
+
+    Eigen::MatrixXd A = Aop.get_full_mat();
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+
+    auto lambda = DS.eigenvalues();
+    auto lambda_ref = es.eigenvalues().head(neigen);
+    bool check_eigenvalues = lambda.isApprox(lambda_ref,1E-6);
+    
+    BOOST_CHECK_EQUAL(check_eigenvalues,1);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_matrix_free_threads) {
+
+    int size = 400;
+    int neigen = 4;
+
+    TestOperator Aop(size);
+    DavidsonSolver DS;
+    DS.set_num_threads(3);
+    DS.solve(Aop,neigen);
+
+    Eigen::MatrixXd A = Aop.get_full_mat();
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+
+    auto lambda = DS.eigenvalues();
+    auto lambda_ref = es.eigenvalues().head(neigen);
+    bool check_eigenvalues = lambda.isApprox(lambda_ref,1E-6);
+    
+    BOOST_CHECK_EQUAL(check_eigenvalues,1);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_sparse_operator) {
+
+    int size = 1000;
+    int neigen = 10;
+
+    TestOperator Aop(size);
+    SparseOperator Sop(Aop,1E-5);
+    BOOST_CHECK_EQUAL(Sop.nonZeros() < size*size/10,1);
+
+    DavidsonSolver DS;
+    DS.solve(Sop,neigen);
+
+    Eigen::MatrixXd A = Sop.get_full_mat();
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+
+    auto lambda = DS.eigenvalues();
+    auto lambda_ref = es.eigenvalues().head(neigen);
+    bool check_eigenvalues = lambda.isApprox(lambda_ref,1E-6);
+    
+    BOOST_CHECK_EQUAL(check_eigenvalues,1);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_mixed_precision) {
+
+    int size = 1000;
+    int neigen = 10;
+
+    TestOperator Aop(size);
+    Eigen::MatrixXd A = Aop.get_full_mat();
+
+    DavidsonSolver DS;
+    DS.set_mixed_precision(true);
+    DS.set_tolerance(1E-8);
+    DS.solve(Aop,neigen);
+
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+    auto lambda = DS.eigenvalues();
+    auto lambda_ref = es.eigenvalues().head(neigen);
+    bool check_eigenvalues = lambda.isApprox(lambda_ref,1E-10);
+    BOOST_CHECK_EQUAL(check_eigenvalues,1);
+
+    // the final residues are below the double precision tolerance
+    Eigen::MatrixXd X = DS.eigenvectors();
+    Eigen::MatrixXd R = A*X - X*lambda.asDiagonal();
+    BOOST_CHECK_EQUAL(R.colwise().norm().maxCoeff() < 1E-8,1);
+
+    // dense matrices are rounded for the single precision iterations
+    DavidsonSolver DS_dense;
+    DS_dense.set_mixed_precision(true);
+    DS_dense.set_tolerance(1E-8);
+    DS_dense.solve(A,neigen);
+    BOOST_CHECK_EQUAL(DS_dense.eigenvalues().isApprox(lambda_ref,1E-10),1);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_generalized) {
+
+    int size = 500;
+    int neigen = 10;
+
+    TestOperator Aop(size);
+    Eigen::MatrixXd A = Aop.get_full_mat();
+
+    // symmetric positive definite metric
+    Eigen::MatrixXd B = init_matrix(size,0.001,true);
+    B.diagonal().setConstant(1.0);
+    B.diagonal().head(size/2).array() += 1.0;
+
+    Eigen::GeneralizedSelfAdjointEigenSolver<Eigen::MatrixXd> es(A,B);
+    auto lambda_ref = es.eigenvalues().head(neigen);
+
+    DavidsonSolver DS;
+    DS.set_tolerance(1E-8);
+    DS.solve(Aop,B,neigen);
+    BOOST_CHECK_EQUAL(DS.eigenvalues().isApprox(lambda_ref,1E-8),1);
+
+    // B-orthonormal eigenvectors
+    Eigen::MatrixXd X = DS.eigenvectors();
+    Eigen::MatrixXd XBX = X.transpose()*B*X;
+    BOOST_CHECK_EQUAL(XBX.isIdentity(1E-8),1);
+    Eigen::MatrixXd R = A*X - B*X*DS.eigenvalues().asDiagonal();
+    BOOST_CHECK_EQUAL(R.colwise().norm().maxCoeff() < 1E-8,1);
+
+    DavidsonSolver DS_olsen;
+    DS_olsen.set_correction("OLSEN");
+    DS_olsen.set_tolerance(1E-8);
+    DS_olsen.solve(A,B,neigen);
+    BOOST_CHECK_EQUAL(DS_olsen.eigenvalues().isApprox(lambda_ref,1E-8),1);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_target) {
+
+    int size = 1000;
+    int neigen = 6;
+    double sigma = 500.3;
+
+    TestOperator Aop(size);
+    Eigen::MatrixXd A = Aop.get_full_mat();
+
+    // reference : eigenvalues sorted by distance to sigma
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+    Eigen::VectorXd ev = es.eigenvalues();
+    std::sort(ev.data(),ev.data()+ev.size(),
+              [&](double a, double b){return std::abs(a-sigma)<std::abs(b-sigma);});
+    Eigen::VectorXd lambda_ref = ev.head(neigen);
+
+    DavidsonSolver DS;
+    DS.set_target(sigma);
+    DS.set_tolerance(1E-8);
+    DS.solve(Aop,neigen);
+    BOOST_CHECK_EQUAL(DS.eigenvalues().isApprox(lambda_ref,1E-8),1);
+
+    Eigen::MatrixXd X = DS.eigenvectors();
+    Eigen::MatrixXd R = A*X - X*DS.eigenvalues().asDiagonal();
+    BOOST_CHECK_EQUAL(R.colwise().norm().maxCoeff() < 1E-7,1);
+
+    DavidsonSolver DS_olsen;
+    DS_olsen.set_correction("OLSEN");
+    DS_olsen.set_target(sigma);
+    DS_olsen.set_tolerance(1E-8);
+    DS_olsen.solve(A,neigen);
+    BOOST_CHECK_EQUAL(DS_olsen.eigenvalues().isApprox(lambda_ref,1E-8),1);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_preconditioner) {
+
+    int size = 800;
+    int neigen = 8;
+    int block_size = 8;
+
+    // strongly coupled diagonal blocks and a weak coupling between them
+    Eigen::MatrixXd A = init_matrix(size,0.001,true);
+    for (int k=0; k<size; k+=block_size) {
+        Eigen::MatrixXd Ak = 0.5 * Eigen::MatrixXd::Random(block_size,block_size);
+        A.block(k,k,block_size,block_size) += Ak + Ak.transpose();
+    }
+
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+    auto lambda_ref = es.eigenvalues().head(neigen);
+
+    BlockDiagonalPreconditioner M(A,block_size);
+
+    DavidsonSolver DS;
+    DS.set_preconditioner(M);
+    DS.solve(A,neigen);
+    BOOST_CHECK_EQUAL(DS.eigenvalues().isApprox(lambda_ref,1E-6),1);
+
+    DavidsonSolver DS_olsen;
+    DS_olsen.set_correction("OLSEN");
+    DS_olsen.set_preconditioner(M);
+    DS_olsen.solve(A,neigen);
+    BOOST_CHECK_EQUAL(DS_olsen.eigenvalues().isApprox(lambda_ref,1E-6),1);
+
+    DavidsonSolver DS_clamped;
+    DS_clamped.set_preconditioner("CLAMPED");
+    DS_clamped.solve(A,neigen);
+    BOOST_CHECK_EQUAL(DS_clamped.eigenvalues().isApprox(lambda_ref,1E-6),1);
+
+    BOOST_CHECK_THROW(DS.set_preconditioner("ILU"),std::runtime_error);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_warm_start) {
+
+    int size = 1000;
+    int neigen = 10;
+    double eps = 0.01;
+    Eigen::MatrixXd A = init_matrix(size,eps,false);
+
+    DavidsonSolver DS;
+    DS.solve(A,neigen);
+
+    // slightly different problem started from the previous eigenvectors
+    Eigen::MatrixXd dA = 1E-6 * Eigen::MatrixXd::Random(size,size);
+    Eigen::MatrixXd A2 = A + dA + dA.transpose();
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A2);
+    auto lambda_ref = es.eigenvalues().head(neigen);
+
+    DS.set_initial_guess(DS.eigenvectors());
+    DS.solve(A2,neigen);
+    BOOST_CHECK_EQUAL(DS.eigenvalues().isApprox(lambda_ref,1E-6),1);
+
+    // a guess with fewer columns than the initial guess size is completed
+    DavidsonSolver DS_partial;
+    DS_partial.set_initial_guess(DS.eigenvectors().leftCols(3));
+    DS_partial.solve(A2,neigen);
+    BOOST_CHECK_EQUAL(DS_partial.eigenvalues().isApprox(lambda_ref,1E-6),1);
+
+    DS_partial.set_initial_guess(Eigen::MatrixXd::Random(size/2,neigen));
+    BOOST_CHECK_THROW(DS_partial.solve(A2,neigen),std::runtime_error);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_checkpoint) {
+
+    int size = 1000;
+    int neigen = 10;
+    std::string filename = "davidson_test.chk";
+
+    Eigen::MatrixXd A = init_matrix(size,0.01,false);
+
+    DavidsonSolver DS_ref;
+    DS_ref.set_tolerance(1E-8);
+    DS_ref.set_max_search_space(30);
+    DS_ref.solve(A,neigen);
+
+    // interrupted run : the current Ritz pairs are returned
+    DavidsonSolver DS;
+    DS.set_tolerance(1E-8);
+    DS.set_max_search_space(30);
+    DS.set_iter_max(5);
+    DS.set_checkpoint(filename,2);
+    DS.set_return_unconverged(true);
+    DS.solve(A,neigen);
+    BOOST_CHECK_EQUAL(DS.eigenvalues().isZero(),0);
+
+    // the resumed run gives the same result as the uninterrupted one
+    DavidsonSolver DS_resume;
+    DS_resume.set_tolerance(1E-8);
+    DS_resume.set_max_search_space(30);
+    DS_resume.set_resume(filename);
+    DS_resume.solve(A,neigen);
+    BOOST_CHECK_EQUAL(DS_resume.eigenvalues() == DS_ref.eigenvalues(),1);
+    BOOST_CHECK_EQUAL(DS_resume.eigenvectors() == DS_ref.eigenvectors(),1);
+
+    // the checkpoint doesn't match another problem
+    DS_resume.set_resume(filename);
+    BOOST_CHECK_THROW(DS_resume.solve(A,neigen+1),std::runtime_error);
+    std::remove(filename.c_str());
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_out_of_core) {
+
+    int size = 1000;
+    int neigen = 10;
+
+    TestOperator Aop(size);
+    Eigen::MatrixXd A = Aop.get_full_mat();
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+    auto lambda_ref = es.eigenvalues().head(neigen);
+
+    DavidsonSolver DS;
+    DS.set_out_of_core(".");
+    DS.set_max_search_space(30);
+    DS.solve(Aop,neigen);
+    BOOST_CHECK_EQUAL(DS.eigenvalues().isApprox(lambda_ref,1E-6),1);
+
+    // generalized problem : BV is mapped as well
+    Eigen::VectorXd b = Eigen::VectorXd::LinSpaced(size,1.0,2.0);
+    Eigen::MatrixXd B = b.asDiagonal();
+    Eigen::GeneralizedSelfAdjointEigenSolver<Eigen::MatrixXd> ges(A,B);
+    DS.solve(A,B,neigen);
+    BOOST_CHECK_EQUAL(DS.eigenvalues().isApprox(ges.eigenvalues().head(neigen),1E-6),1);
+
+    DavidsonSolver DS_missing;
+    DS_missing.set_out_of_core("/nonexistent/directory");
+    BOOST_CHECK_THROW(DS_missing.solve(A,neigen),std::runtime_error);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_mapped_matrix) {
+
+    int size = 500;
+    int neigen = 10;
+    std::string filename = "davidson_test.bin";
+    std::string textname = "davidson_test.txt";
+
+    Eigen::MatrixXd A = init_matrix(size,0.01,false);
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+    auto lambda_ref = es.eigenvalues().head(neigen);
+
+    // text matrix converted to the binary format
+    std::ofstream out(textname);
+    out.precision(17);
+    out << A << std::endl;
+    out.close();
+    MappedMatrix::write(filename,read_text_matrix(textname));
+
+    {
+        MappedMatrix Amapped(filename);
+        MappedMatrix::ConstMap Amap = Amapped.matrix();
+        BOOST_CHECK_EQUAL(Amap == A,1);
+        BOOST_CHECK_EQUAL(Amapped.symmetric(),1);
+
+        DavidsonSolver DS;
+        DS.solve(Amap,neigen);
+        BOOST_CHECK_EQUAL(DS.eigenvalues().isApprox(lambda_ref,1E-6),1);
+    }
+
+    // the scalar type is checked
+    BOOST_CHECK_THROW(MappedMatrixT<float> Afloat(filename),std::runtime_error);
+    BOOST_CHECK_THROW(MappedMatrix Atext(textname),std::runtime_error);
+    std::remove(filename.c_str());
+    std::remove(textname.c_str());
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_matrix_market) {
+
+    int size = 1000;
+    int neigen = 10;
+    std::string filename = "davidson_test.mtx";
+
+    TestOperator Aop(size);
+    SparseOperator Asp(Aop,1E-5);
+    Eigen::MatrixXd A = Asp.matrix();
+
+    // lower part of the symmetric matrix
+    std::ofstream out(filename);
+    out.precision(17);
+    out << "%%MatrixMarket matrix coordinate real symmetric" << std::endl;
+    out << "% test operator" << std::endl;
+    out << size << " " << size << " " << (Asp.nonZeros()+size)/2 << std::endl;
+    for (int j=0; j<size; j++)
+        for (int i=j; i<size; i++)
+            if (A(i,j) != 0) out << i+1 << " " << j+1 << " " << A(i,j) << std::endl;
+    out.close();
+
+    // small blocks : the lines are split between the blocks
+    SparseOperator Amtx(read_matrix_market(filename,1000));
+    BOOST_CHECK_EQUAL(Eigen::MatrixXd(Amtx.matrix()) == A,1);
+
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+    DavidsonSolver DS;
+    DS.solve(Amtx,neigen);
+    BOOST_CHECK_EQUAL(DS.eigenvalues().isApprox(es.eigenvalues().head(neigen),1E-6),1);
+
+    out.open(filename);
+    out << "%%MatrixMarket matrix array real general" << std::endl;
+    out.close();
+    BOOST_CHECK_THROW(read_matrix_market(filename),std::runtime_error);
+    std::remove(filename.c_str());
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_counters) {
+
+    int size = 500;
+    int neigen = 5;
+
+    TestOperator Aop(size);
+
+    // the initial guess and one correction per unconverged root and iteration
+    DavidsonSolver DS;
+    DS.solve(Aop,neigen);
+    BOOST_CHECK_EQUAL(DS.converged(),1);
+    BOOST_CHECK_EQUAL(DS.iterations() > 0,1);
+    BOOST_CHECK_EQUAL(DS.matvecs() >= 10 + (DS.iterations()-1),1);
+    BOOST_CHECK_EQUAL(DS.matvecs() <= 10 + neigen*(DS.iterations()-1),1);
+
+    DavidsonSolver DS_short;
+    DS_short.set_tolerance(1E-12);
+    DS_short.set_iter_max(1);
+    DS_short.solve(Aop,neigen);
+    BOOST_CHECK_EQUAL(DS_short.converged(),0);
+    BOOST_CHECK_EQUAL(DS_short.iterations(),1);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_statistics) {
+
+    int size = 500;
+    int neigen = 5;
+
+    TestOperator Aop(size);
+
+    // the messages go to the log sink, there are none by default
+    std::string log;
+    DavidsonSolver DS;
+    DS.set_log_sink([&](const std::string &message){log += message;});
+    DS.set_correction("JACOBI");
+    DS.solve(Aop,neigen);
+    BOOST_CHECK_EQUAL(log.find("Davidson converged") != std::string::npos,1);
+
+    const DavidsonStatistics &stats = DS.statistics();
+    BOOST_CHECK_EQUAL(stats.history.size(),DS.iterations());
+    BOOST_CHECK_EQUAL(stats.subspace.calls,DS.iterations());
+    BOOST_CHECK_EQUAL(stats.apply.count,DS.matvecs());
+    BOOST_CHECK_EQUAL(stats.linsolve.count > 0,1);
+    BOOST_CHECK_EQUAL(stats.correction.count > 0,1);
+    BOOST_CHECK_EQUAL(stats.history.back().converged,neigen);
+    BOOST_CHECK_EQUAL(stats.history.back().residue_norm < 1E-6,1);
+
+    DS.set_log_sink(nullptr);
+    log.clear();
+    DS.solve(Aop,neigen);
+    BOOST_CHECK_EQUAL(log.empty(),1);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_async) {
+
+    int size = 1000;
+    int neigen = 10;
+    Eigen::MatrixXd A = init_matrix(size,0.01,false);
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+
+    // the observer sees every iteration
+    int nobserved = 0;
+    DavidsonSolver DS;
+    DS.set_observer([&](const DavidsonIteration &record, const Eigen::ArrayXd &res, const Eigen::ArrayXd &dlambda){
+        BOOST_CHECK_EQUAL(record.iteration,nobserved);
+        BOOST_CHECK_EQUAL(res.size(),neigen);
+        nobserved++;
+    });
+    std::future<void> result = DS.solve_async(A,neigen);
+    result.get();
+    BOOST_CHECK_EQUAL(DS.converged(),1);
+    BOOST_CHECK_EQUAL(nobserved,DS.iterations());
+    BOOST_CHECK_EQUAL(DS.eigenvalues().isApprox(es.eigenvalues().head(neigen),1E-6),1);
+
+    // cancelled after the second iteration : the current Ritz pairs are kept
+    DavidsonCancellation token;
+    DavidsonSolver DS_cancel;
+    DS_cancel.set_cancellation(token);
+    DS_cancel.set_observer([&](const DavidsonIteration &record, const Eigen::ArrayXd &, const Eigen::ArrayXd &){
+        if (record.iteration == 1) token.cancel();
+    });
+    DS_cancel.solve_async(A,neigen).get();
+    BOOST_CHECK_EQUAL(DS_cancel.cancelled(),1);
+    BOOST_CHECK_EQUAL(DS_cancel.converged(),0);
+    BOOST_CHECK_EQUAL(DS_cancel.iterations(),2);
+    BOOST_CHECK_EQUAL(DS_cancel.eigenvalues().isApprox(es.eigenvalues().head(neigen),1E-2),1);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_batch) {
+
+    // dense and matrix free problems of different sizes
+    std::vector<Eigen::MatrixXd> dense;
+    for (int size : {60, 200, 100, 300}) dense.push_back(init_matrix(size,0.01,false));
+    DavidsonOperator Aop(250,0.01,false,false);
+
+    DavidsonSolver DS;
+    DS.set_tolerance(1E-8);
+    DavidsonBatch batch(DS);
+    batch.set_num_threads(2);
+    for (auto &A : dense) batch.add(A,5);
+    int iop = batch.add(Aop,8,1E-6);
+    BOOST_CHECK_EQUAL(batch.size(),5);
+    batch.solve();
+
+    for (std::size_t i=0; i<dense.size(); i++) {
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(dense[i]);
+        BOOST_CHECK_EQUAL(batch.converged(i),1);
+        BOOST_CHECK_EQUAL(batch.eigenvectors(i).rows(),dense[i].rows());
+        BOOST_CHECK_EQUAL(batch.eigenvalues(i).isApprox(es.eigenvalues().head(5),1E-6),1);
+    }
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(Aop.get_full_mat());
+    BOOST_CHECK_EQUAL(batch.converged(iop),1);
+    BOOST_CHECK_EQUAL(batch.eigenvalues(iop).isApprox(es.eigenvalues().head(8),1E-6),1);
+
+}
+
+#ifdef USE_MPI
+BOOST_AUTO_TEST_CASE(davidson_distributed) {
+
+    // every rank builds the same operator and keeps its rows
+    int size = 500;
+    int neigen = 8;
+    DavidsonOperator Aop(size,0.01,false,false);
+    DistributedOperator A(Aop,0.0);
+
+    int nranks;
+    MPI_Comm_size(MPI_COMM_WORLD,&nranks);
+    int nrows = A.local_rows();
+    MPI_Allreduce(MPI_IN_PLACE,&nrows,1,MPI_INT,MPI_SUM,MPI_COMM_WORLD);
+    BOOST_CHECK_EQUAL(nrows,size);
+
+    DistributedDavidsonSolver DS;
+    DS.set_tolerance(1E-8);
+    DS.set_max_search_space(30);
+    DS.solve(A,neigen);
+    BOOST_CHECK_EQUAL(DS.converged(),1);
+    BOOST_CHECK_EQUAL(DS.eigenvectors().rows(),A.local_rows());
+
+    Eigen::MatrixXd Afull = Aop.get_full_mat();
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(Afull);
+    BOOST_CHECK_EQUAL(DS.eigenvalues().isApprox(es.eigenvalues().head(neigen),1E-6),1);
+
+    // the gathered eigenvectors are those of the whole operator
+    Eigen::MatrixXd X = A.gather(DS.eigenvectors());
+    Eigen::MatrixXd R = Afull * X - X * DS.eigenvalues().asDiagonal();
+    BOOST_CHECK_LT(R.colwise().norm().maxCoeff(),1E-6);
+
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(davidson_complex_hermitian) {
+
+    int size = 500;
+    int neigen = 10;
+
+    ComplexTestOperator Aop(size);
+    Eigen::MatrixXcd A = Aop.get_full_mat();
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXcd> es(A);
+    auto lambda_ref = es.eigenvalues().head(neigen);
+
+    DavidsonSolverT<std::complex<double>> DS;
+    DS.solve(Aop,neigen);
+    BOOST_CHECK_EQUAL(DS.eigenvalues().isApprox(lambda_ref,1E-6),1);
+
+    // the eigenvectors are complex
+    Eigen::MatrixXcd X = DS.eigenvectors();
+    Eigen::MatrixXcd R = A*X - X*DS.eigenvalues().asDiagonal();
+    BOOST_CHECK_EQUAL(R.colwise().norm().maxCoeff() < 1E-5,1);
+
+    DavidsonSolverT<std::complex<double>> DS_dense;
+    DS_dense.set_correction("OLSEN");
+    DS_dense.solve(A,neigen);
+    BOOST_CHECK_EQUAL(DS_dense.eigenvalues().isApprox(lambda_ref,1E-6),1);
+
+    DavidsonSolverT<std::complex<double>> DS_jacobi;
+    DS_jacobi.set_correction("JACOBI");
+    DS_jacobi.solve(Aop,neigen);
+    BOOST_CHECK_EQUAL(DS_jacobi.eigenvalues().isApprox(lambda_ref,1E-6),1);
+
+}
+
+BOOST_AUTO_TEST_CASE(davidson_single_precision) {
+
+    int size = 500;
+    int neigen = 10;
+
+    TestOperator Aop(size);
+    Eigen::MatrixXd A = Aop.get_full_mat();
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(A);
+    Eigen::VectorXf lambda_ref = es.eigenvalues().head(neigen).cast<float>();
+
+    // float search space with a double operator (apply_single)
+    DavidsonSolverT<float> DS;
+    DS.set_tolerance(1E-3);
+    DS.solve(Aop,neigen);
+    BOOST_CHECK_EQUAL(DS.eigenvalues().isApprox(lambda_ref,1E-5),1);
+
+    // float dense matrix
+    Eigen::MatrixXf Af = A.cast<float>();
+    DavidsonSolverT<float> DS_dense;
+    DS_dense.set_tolerance(1E-3);
+    DS_dense.solve(Af,neigen);
+    BOOST_CHECK_EQUAL(DS_dense.eigenvalues().isApprox(lambda_ref,1E-5),1);
+
+}
+
+BOOST_AUTO_TEST_CASE(matrix_free_apply) {
+
+    int size = 200;
+    int nvec = 7;
+
+    DavidsonOperator Aop(size,0.01,false,true);
+    TestOperator Top(size);
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(size,nvec);
+
+    Eigen::MatrixXd A = Aop.get_full_mat();
+    Eigen::MatrixXd AX = Aop * X;
+    Eigen::VectorXd Ax = Aop * X.col(0);
+    BOOST_CHECK_EQUAL(AX.isApprox(A*X,1E-10),1);
+    BOOST_CHECK_EQUAL(Ax.isApprox(A*X.col(0),1E-10),1);
+
+    Eigen::MatrixXd T = Top.get_full_mat();
+    Eigen::MatrixXd TX = Top * X;
+    BOOST_CHECK_EQUAL(TX.isApprox(T*X,1E-10),1);
+
+}
+
+BOOST_AUTO_TEST_CASE(matrix_free_diagonal) {
+
+    int size = 200;
+
+    DavidsonOperator Aop(size,0.01,false,true);
+    TestOperator Top(size);
+
+    Eigen::VectorXd dA = Aop.get_full_mat().diagonal();
+    Eigen::VectorXd dT = Top.get_full_mat().diagonal();
+    BOOST_CHECK_EQUAL(Aop.diagonal().isApprox(dA),1);
+    BOOST_CHECK_EQUAL(Top.diagonal().isApprox(dT),1);
+    BOOST_CHECK_EQUAL(Aop.diagonal_element(3),dA(3));
+
+}
+
 //BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file